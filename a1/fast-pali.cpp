@@ -1,135 +1,633 @@
 #include <unistd.h>
+#include <errno.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
 #include <stdio.h>
-#include <stdio.h>
-#include <ctype.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
 #include <string>
+#include <string_view>
+#include <thread>
 #include <vector>
-
-/*CODE SEGMENT FROM https://gitlab.com/cpsc457p21/longest-int-my-getchar */
-/*START CODE SEGMENT*/
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define PALI_X86_DISPATCH
+#include <immintrin.h>
+#endif
 
 // we'll use global variables to track of characters that we
 // read() into memory
-char buffer[1024 * 1024]; // 1MB sotrage to hold results of read()
-int buff_size = 0;        // stores how many characters are stored in buffer
-int buff_pos = 0;         // position in buffer[] where we extract next char
-
-// returns the next char from stdin, or -1 on EOF
-// returns characters stored in buffer[] until it is empty
-// when buffer[] gets empty, it is replenished by calling read()
-int
-fast_read_one_character_from_stdin()
-{
-    // check if buffer[] is empty
-    if (buff_pos >= buff_size)
+char buffer[1024 * 1024]; // 1MB storage to hold results of read()
+
+// returns true for the characters isspace() reports in the C locale
+//    i.e. ' ', '\n', '\r', '\t', '\v', '\f'
+static inline bool
+is_space(unsigned char c)
+{
+    return c == ' ' || (unsigned char)(c - '\t') <= '\r' - '\t';
+}
+
+#ifdef __SSE2__
+// classifies 16 bytes at once, bit i of the result is set if p[i] is white space
+static inline unsigned
+space_mask16(const char *p)
+{
+    __m128i v = _mm_loadu_si128((const __m128i *)p);
+    __m128i t = _mm_sub_epi8(v, _mm_set1_epi8('\t'));  // '\t'..'\r' become 0..4
+    __m128i ctrl = _mm_cmpeq_epi8(_mm_min_epu8(t, _mm_set1_epi8(4)), t);
+    __m128i sp = _mm_cmpeq_epi8(v, _mm_set1_epi8(' '));
+    return _mm_movemask_epi8(_mm_or_si128(ctrl, sp));
+}
+#endif
+
+// returns pointer to the first white space character in [p, end), or end
+static const char *
+find_space(const char *p, const char *end)
+{
+#ifdef __SSE2__
+    for (; end - p >= 16; p += 16)
+        if (unsigned m = space_mask16(p))
+            return p + __builtin_ctz(m);
+#endif
+    while (p < end && !is_space(*p))
+        p++;
+    return p;
+}
+
+// returns pointer to the first non white space character in [p, end), or end
+static const char *
+skip_spaces(const char *p, const char *end)
+{
+#ifdef __SSE2__
+    for (; end - p >= 16; p += 16)
+        if (unsigned m = ~space_mask16(p) & 0xffff)
+            return p + __builtin_ctz(m);
+#endif
+    while (p < end && is_space(*p))
+        p++;
+    return p;
+}
+
+// calls on_word() for every word in [p, end) that is followed by white space
+// returns the start of the last word if it runs into end, otherwise end
+template <typename F>
+static const char *
+scan_words(const char *p, const char *end, F &&on_word)
+{
+    while (1)
+    {
+        p = skip_spaces(p, end);
+        if (p == end)
+            return end;
+        const char *e = find_space(p, end);
+        if (e == end)
+            return p;
+        on_word(std::string_view(p, e - p));
+        p = e;
+    }
+}
+
+// calls on_word() for every word on standard input
+// words are views straight into buffer[], only a word that straddles
+// two read() calls is copied (into carry) so it can be passed whole
+// memory use is buffer[] plus the longest word, no matter how long the
+// lines are
+template <typename F>
+static void
+for_each_stdin_word(F &&on_word)
+{
+    std::string carry;
+    while (1)
     {
-        // buffer is empty, let's replenish it
-        buff_size = read(STDIN_FILENO, buffer, sizeof(buffer));
-        // detect EOF
-        if (buff_size <= 0)
-            return -1; //RETURNS -1 ON EOF
-        // reset position from where we'll return characters
-        buff_pos = 0;
+        ssize_t n = read(STDIN_FILENO, buffer, sizeof(buffer));
+        if (n < 0 && errno == EINTR)
+            continue;
+        if (n <= 0)
+            break; // EOF (or read error)
+        const char *p = buffer, *end = buffer + n;
+        if (!carry.empty())
+        {
+            // finish the word left over from the previous read()
+            const char *e = find_space(p, end);
+            carry.append(p, e);
+            if (e == end)
+                continue;
+            on_word(std::string_view(carry));
+            carry.clear();
+            if (carry.capacity() > sizeof(buffer))
+                carry.shrink_to_fit(); // don't hold on to a huge word
+            p = e;
+        }
+        carry.assign(scan_words(p, end, on_word), end);
     }
-    // return the next character from the buffer and update position
-    return buffer[buff_pos++];
+    if (!carry.empty())
+        on_word(std::string_view(carry));
+}
+
+// read-only mapping of stdin, begin/end delimit the part not consumed yet
+struct StdinMap
+{
+    void *base = nullptr;
+    size_t len = 0;
+    const char *begin = nullptr, *end = nullptr;
+};
+
+// maps stdin into memory if it is a regular (non-empty) file
+// returns false for pipes, terminals etc., which have to go through read()
+static bool
+map_stdin(StdinMap &m)
+{
+    struct stat st;
+    if (fstat(STDIN_FILENO, &st) != 0 || !S_ISREG(st.st_mode) || st.st_size <= 0)
+        return false;
+    // start wherever the file offset is, in case someone already read from it
+    off_t pos = lseek(STDIN_FILENO, 0, SEEK_CUR);
+    if (pos < 0 || pos >= st.st_size)
+        return false;
+    void *p = mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, STDIN_FILENO, 0);
+    if (p == MAP_FAILED)
+        return false;
+    madvise(p, st.st_size, MADV_SEQUENTIAL);
+    m.base = p;
+    m.len = st.st_size;
+    m.begin = (const char *)p + pos;
+    m.end = (const char *)p + st.st_size;
+    return true;
 }
 
-/*END CODE SEGMENT */
+static void
+unmap_stdin(StdinMap &m)
+{
+    if (m.base)
+        munmap(m.base, m.len);
+    m = StdinMap();
+}
+
+// the mapping is scanned in windows of this size, and the pages behind the
+// scan are dropped, so the resident size stays bounded by the window plus
+// the longest word even for a multi-GB file with no line breaks
+constexpr size_t MAP_WINDOW = 64 * 1024 * 1024;
 
-// split string p_line into a vector of strings (words)
-// the delimiters are 1 or more whitespaces
-std::vector<std::string>
-split(const std::string &p_line)
+// calls on_word() for every word on standard input
+// a regular file is scanned in place through mmap(), anything else
+// goes through the buffered reader
+template <typename F>
+static void
+for_each_word(F &&on_word)
 {
-    auto line = p_line + " ";
-    std::vector<std::string> res;
-    bool in_str = false;
-    std::string curr_word = "";
-    for (auto c : line)
+    StdinMap m;
+    if (!map_stdin(m))
+    {
+        for_each_stdin_word(on_word);
+        return;
+    }
+    const long page = sysconf(_SC_PAGESIZE);
+    const char *p = m.begin, *released = (const char *)m.base;
+    while (p < m.end)
     {
-        if (isspace(c))
+        const char *wend = size_t(m.end - p) > MAP_WINDOW ? p + MAP_WINDOW : m.end;
+        const char *tail = scan_words(p, wend, on_word);
+        if (wend == m.end || tail == p)
         {
-            if (in_str)
-                res.push_back(curr_word);
-            in_str = false;
-            curr_word = "";
+            // last window, or a word longer than a whole window
+            const char *e = find_space(tail, m.end);
+            if (e != tail)
+                on_word(std::string_view(tail, e - tail));
+            tail = e;
         }
-        else
+        // everything before the unfinished word has been consumed
+        const char *drop = (const char *)m.base + (tail - (const char *)m.base) / page * page;
+        if (drop > released)
         {
-            curr_word.push_back(c);
-            in_str = true;
+            madvise((void *)released, drop - released, MADV_DONTNEED);
+            released = drop;
         }
+        p = tail;
     }
-    return res;
+    unmap_stdin(m);
 }
 
-// reads in a line from STDIN
-// reads until \n or EOF and result includes \n if present
-// returns empty string on EOF
-std::string
-stdin_readline()
-{
-    std::string result;
-    //FUNCTION MODIFIED PAST THIS PART
-    while (int ch = fast_read_one_character_from_stdin()) {
-        result.push_back(ch); //adds the character to the string
-        if(ch == '\n') { //if the char is a newline
-            break; //break the loop
-        }
-        else if(ch == -1) { //if reached end of file
-            return ""; //return empty string
-        }
+// tolower() of the C locale as a table, only 'A'..'Z' change
+struct FoldTable
+{
+    unsigned char t[256];
+    constexpr FoldTable() : t()
+    {
+        for (int c = 0; c < 256; c++)
+            t[c] = (c >= 'A' && c <= 'Z') ? c + ('a' - 'A') : c;
     }
-    return result; //returns the whole line
+    unsigned char operator[](char c) const { return t[(unsigned char)c]; }
+};
+static constexpr FoldTable fold;
+
+// compares s[i..] with s[..j) reversed, one pair of characters at a time
+static bool
+is_palindrome_scalar(const char *s, size_t i, size_t j)
+{
+    for (; i + 1 < j; i++, j--)
+        if (fold[s[i]] != fold[s[j - 1]])
+            return false;
+    return true;
+}
+
+#ifdef PALI_X86_DISPATCH
+// the vector kernels fold case by OR-ing 0x20 into bytes in 'A'..'Z'
+// and compare a block from the front with a byte-reversed block from the
+// back, when fewer than two blocks are left the last block is compared
+// overlapping the previous ones, and anything shorter than one block is
+// left to the next smaller kernel
+
+static inline __m128i
+fold16(__m128i v)
+{
+    __m128i t = _mm_sub_epi8(v, _mm_set1_epi8('A'));
+    __m128i up = _mm_cmpeq_epi8(_mm_min_epu8(t, _mm_set1_epi8(25)), t);
+    return _mm_or_si128(v, _mm_and_si128(up, _mm_set1_epi8(0x20)));
 }
 
+// true if s[a..a+16) equals s[b-16..b) reversed
+__attribute__((target("ssse3"))) static inline bool
+same16(const char *s, size_t a, size_t b)
+{
+    const __m128i rev = _mm_setr_epi8(15, 14, 13, 12, 11, 10, 9, 8, 7, 6, 5, 4, 3, 2, 1, 0);
+    __m128i f = fold16(_mm_loadu_si128((const __m128i *)(s + a)));
+    __m128i r = fold16(_mm_loadu_si128((const __m128i *)(s + b - 16)));
+    return _mm_movemask_epi8(_mm_cmpeq_epi8(f, _mm_shuffle_epi8(r, rev))) == 0xffff;
+}
+
+__attribute__((target("ssse3"))) static bool
+is_palindrome_ssse3(const char *s, size_t i, size_t j)
+{
+    for (; j - i >= 32; i += 16, j -= 16)
+        if (!same16(s, i, j))
+            return false;
+    if (j - i >= 16)
+        return same16(s, i, j);
+    return is_palindrome_scalar(s, i, j);
+}
+
+__attribute__((target("avx2"))) static inline __m256i
+fold32(__m256i v)
+{
+    __m256i t = _mm256_sub_epi8(v, _mm256_set1_epi8('A'));
+    __m256i up = _mm256_cmpeq_epi8(_mm256_min_epu8(t, _mm256_set1_epi8(25)), t);
+    return _mm256_or_si256(v, _mm256_and_si256(up, _mm256_set1_epi8(0x20)));
+}
+
+// true if s[a..a+32) equals s[b-32..b) reversed
+__attribute__((target("avx2"))) static inline bool
+same32(const char *s, size_t a, size_t b)
+{
+    const __m256i rev = _mm256_setr_epi8(15, 14, 13, 12, 11, 10, 9, 8, 7, 6, 5, 4, 3, 2, 1, 0,
+                                         15, 14, 13, 12, 11, 10, 9, 8, 7, 6, 5, 4, 3, 2, 1, 0);
+    __m256i f = fold32(_mm256_loadu_si256((const __m256i *)(s + a)));
+    __m256i r = fold32(_mm256_loadu_si256((const __m256i *)(s + b - 32)));
+    // reverse within the 128-bit lanes, then swap the lanes
+    r = _mm256_permute4x64_epi64(_mm256_shuffle_epi8(r, rev), 0x4e);
+    return _mm256_movemask_epi8(_mm256_cmpeq_epi8(f, r)) == -1;
+}
+
+__attribute__((target("avx2"))) static bool
+is_palindrome_avx2(const char *s, size_t i, size_t j)
+{
+    for (; j - i >= 64; i += 32, j -= 32)
+        if (!same32(s, i, j))
+            return false;
+    if (j - i >= 32)
+        return same32(s, i, j);
+    return is_palindrome_ssse3(s, i, j);
+}
+#endif
+
+// picks the widest kernel the CPU supports, once at startup
+using PaliKernel = bool (*)(const char *, size_t, size_t);
+static PaliKernel
+pick_palindrome_kernel()
+{
+#ifdef PALI_X86_DISPATCH
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2"))
+        return is_palindrome_avx2;
+    if (__builtin_cpu_supports("ssse3"))
+        return is_palindrome_ssse3;
+#endif
+    return is_palindrome_scalar;
+}
+static const PaliKernel palindrome_kernel = pick_palindrome_kernel();
+
 // returns true if a word is palindrome
 // palindrome is a string that reads the same forward and backward
 //    after converting all characters to lower case
-bool is_palindrome(const std::string &s)
+bool is_palindrome(std::string_view s)
 {
-    for (size_t i = 0; i < s.size() / 2; i++)
-        if (tolower(s[i]) != tolower(s[s.size() - i - 1]))
-            return false;
-    return true;
+    size_t n = s.size();
+    if (n < 2)
+        return true;
+    // most words fail on the first pair, don't go into the kernel for those
+    if (fold[s[0]] != fold[s[n - 1]])
+        return false;
+    return palindrome_kernel(s.data(), 1, n - 1);
+}
+
+// longest palindrome found in a range, as offset + length
+struct Pali
+{
+    size_t pos = 0, len = 0;
+};
+
+// Manacher's algorithm over s[0..n), with characters compared after folding
+// case the same way is_palindrome() does
+// it works on the string with a separator between all characters (and at
+// both ends), t[k] is s[k / 2] for odd k and a separator for even k, so
+// p[k] is the length of the longest palindrome in s centered at t[k]
+// returns the first of the longest palindromes, in O(n) time
+template <typename Idx>
+static Pali
+manacher(const char *s, size_t n, std::vector<Idx> &p)
+{
+    const size_t m = 2 * n + 1;
+    p.assign(m, 0);
+    Pali best;
+    size_t l = 0, r = 0; // t[l..r] is the palindrome reaching furthest right
+    for (size_t k = 0; k < m; k++)
+    {
+        size_t rad = k < r ? std::min<size_t>(p[l + r - k], r - k) : 0;
+        // both ends always have the same parity, so separators match each other
+        while (k >= rad + 1 && k + rad + 1 < m &&
+               ((k - rad - 1) % 2 == 0 || fold[s[(k - rad - 1) / 2]] == fold[s[(k + rad + 1) / 2]]))
+            rad++;
+        p[k] = rad;
+        if (k + rad > r)
+        {
+            l = k - rad;
+            r = k + rad;
+        }
+        size_t pos = (k - rad) / 2;
+        if (rad > best.len || (rad == best.len && pos < best.pos))
+            best = {pos, rad};
+    }
+    return best;
+}
+
+// returns the first longest palindromic substring of s[0..n)
+// the scratch array is kept per thread, 32-bit unless s is over 2GB
+static Pali
+longest_palindromic_substring(const char *s, size_t n)
+{
+    if (2 * n + 1 <= UINT32_MAX)
+    {
+        static thread_local std::vector<uint32_t> p32;
+        return manacher(s, n, p32);
+    }
+    static thread_local std::vector<size_t> p64;
+    return manacher(s, n, p64);
+}
+
+// returns the palindrome a word contributes, as offset + length in the word
+// (length 0 if none), only called when the word could beat min_len
+// with substrings == false the word has to be a palindrome as a whole,
+// otherwise it is its longest palindromic substring
+static Pali
+palindrome_in_word(std::string_view word, size_t min_len, bool substrings)
+{
+    if (!substrings)
+        return is_palindrome(word) ? Pali{0, word.size()} : Pali();
+    Pali p = longest_palindromic_substring(word.data(), word.size());
+    return p.len > min_len ? p : Pali();
 }
 
+// returns the first longest palindrome among the words in [begin, end)
+// the range has to start and end on word boundaries
+static Pali
+longest_palindrome_in(const char *begin, const char *end, bool substrings)
+{
+    Pali best;
+    auto check = [&](std::string_view word) {
+        if (word.size() <= best.len)
+            return;
+        Pali p = palindrome_in_word(word, best.len, substrings);
+        if (p.len > best.len)
+            best = {size_t(word.data() - begin) + p.pos, p.len};
+    };
+    const char *tail = scan_words(begin, end, check);
+    if (tail != end)
+        check(std::string_view(tail, end - tail));
+    return best;
+}
+
+constexpr size_t MIN_CHUNK = 64 * 1024;        // don't bother a thread with less
+constexpr size_t PIPE_CHUNK = 4 * 1024 * 1024; // bytes read per thread from a pipe
+constexpr size_t MAX_PIPE_BLOCK = 16 * PIPE_CHUNK; // whatever the thread count
+
+// splits [begin, end) into up to n_threads ranges at white space and searches
+// them in parallel, the per-range results are reduced in range order so that
+// the first palindrome wins ties exactly like in the serial scan
+static Pali
+parallel_longest_palindrome(const char *begin, const char *end, int n_threads, bool substrings)
+{
+    size_t size = end - begin;
+    n_threads = std::min<size_t>(n_threads, size / MIN_CHUNK + 1);
+    if (n_threads <= 1)
+        return longest_palindrome_in(begin, end, substrings);
+
+    // cut points are moved forward to the next white space, so every word
+    // lies in exactly one range
+    std::vector<const char *> cuts{begin};
+    for (int i = 1; i < n_threads; i++)
+        cuts.push_back(find_space(std::max(begin + size * i / n_threads, cuts.back()), end));
+    cuts.push_back(end);
+
+    std::vector<Pali> results(n_threads);
+    std::vector<std::thread> threads;
+    for (int i = 0; i < n_threads; i++)
+        threads.emplace_back([&, i]() {
+            results[i] = longest_palindrome_in(cuts[i], cuts[i + 1], substrings);
+            results[i].pos += cuts[i] - begin;
+        });
+    for (auto &t : threads)
+        t.join();
+
+    Pali best;
+    for (auto &r : results)
+        if (r.len > best.len)
+            best = r;
+    return best;
+}
+
+// parallel search over stdin that cannot be mapped (pipes etc.)
+// reads blocks of n_threads * PIPE_CHUNK bytes (at most MAX_PIPE_BLOCK, the
+// threads then share it in smaller slices), cuts each block after its
+// last white space and searches the complete words in parallel, the cut off
+// word is moved to the front of the next block
+// the block only grows past its normal size for a word that does not fit,
+// and shrinks back once that word is done
+static std::string
+parallel_stdin_palindrome(int n_threads, bool substrings)
+{
+    std::string max_pali;
+    const size_t block_size = std::min(size_t(n_threads) * PIPE_CHUNK, MAX_PIPE_BLOCK);
+    std::vector<char> block(block_size);
+    size_t used = 0; // bytes in block, starting with the carried word
+    bool eof = false;
+    while (!eof)
+    {
+        while (used < block.size())
+        {
+            ssize_t n = read(STDIN_FILENO, block.data() + used, block.size() - used);
+            if (n < 0 && errno == EINTR)
+                continue;
+            if (n <= 0)
+            {
+                eof = true;
+                break;
+            }
+            used += n;
+        }
+        const char *b = block.data(), *e = b + used, *cut = e;
+        if (!eof)
+        {
+            while (cut > b && !is_space(cut[-1]))
+                cut--;
+            if (cut == b)
+            {
+                // the whole block is a single word, make room for the rest of it
+                block.resize(block.size() * 2);
+                continue;
+            }
+        }
+        Pali p = parallel_longest_palindrome(b, cut, n_threads, substrings);
+        if (p.len > max_pali.size())
+            max_pali.assign(b + p.pos, p.len);
+        used = e - cut;
+        memmove(block.data(), cut, used);
+        if (block.size() > block_size && used <= block_size)
+        {
+            block.resize(block_size);
+            block.shrink_to_fit();
+        }
+    }
+    return max_pali;
+}
+
+constexpr size_t STREAM_WINDOW = 1024 * 1024; // overlap between stream blocks
+
+// returns the first longest palindromic substring of the whole input, white
+// space included
+// input is read in blocks of sizeof(buffer) bytes, and Manacher's algorithm
+// runs over the last STREAM_WINDOW bytes before each block plus the block,
+// so memory stays bounded and every byte is looked at about twice
+// palindromes up to STREAM_WINDOW bytes are found exactly (including the
+// first-occurrence tie rule), longer ones only as far as fits in a window
+static std::string
+stream_palindrome()
+{
+    std::vector<char> win(STREAM_WINDOW + sizeof(buffer));
+    size_t kept = 0;      // bytes carried over from the previous window
+    uint64_t win_pos = 0; // input offset of win[0]
+    std::string max_pali;
+    uint64_t max_pos = 0;
+    bool eof = false;
+    while (!eof)
+    {
+        size_t len = kept;
+        while (len < win.size())
+        {
+            ssize_t n = read(STDIN_FILENO, win.data() + len, win.size() - len);
+            if (n < 0 && errno == EINTR)
+                continue;
+            if (n <= 0)
+            {
+                eof = true;
+                break;
+            }
+            len += n;
+        }
+        if (len == kept)
+            break;
+        Pali p = longest_palindromic_substring(win.data(), len);
+        uint64_t pos = win_pos + p.pos;
+        if (p.len > max_pali.size() || (p.len == max_pali.size() && p.len > 0 && pos < max_pos))
+        {
+            max_pali.assign(win.data() + p.pos, p.len);
+            max_pos = pos;
+        }
+        kept = std::min(len, STREAM_WINDOW);
+        memmove(win.data(), win.data() + len - kept, kept);
+        win_pos += len - kept;
+    }
+    return max_pali;
+}
+
+// what get_longest_palindrome() looks for
+enum class Search
+{
+    Words,      // whole words that are palindromes
+    Substrings, // longest palindromic substring of any word
+    Stream,     // longest palindromic substring of the whole input
+};
+
 // returns the longest palindrome on standard input
 // in case of ties for length, returns the first palindrome
 // all input is broken into words, and each word is checked
 // word is a sequence of characters separated by white space
 // white space is whatever isspace() says it is
 //    i.e. ' ', '\n', '\r', '\t', '\n', '\f'
+// with n_threads > 1 the input is split into ranges searched in parallel,
+// the result is the same as with a single thread
+// Search::Stream ignores word boundaries and always runs on one thread
 std::string
-get_longest_palindrome()
+get_longest_palindrome(int n_threads = 1, Search search = Search::Words)
 {
+    if (search == Search::Stream)
+        return stream_palindrome();
+    bool substrings = search == Search::Substrings;
     std::string max_pali;
-    while (1)
+    if (n_threads > 1)
     {
-        std::string line = stdin_readline();
-        if (line.size() == 0)
-            break;
-        //MODIFIED CODE HERE
-        if(line.compare(0,1,"\n") != 0) //if it's just a newline, skips the palindrome check
-         {
-            //END MODIFIED CODE
-            auto words = split(line);
-            for (auto word : words)
-            {
-                if (word.size() <= max_pali.size())
-                    continue;
-                if (is_palindrome(word))
-                    max_pali = word;
-            }
-         }
+        StdinMap m;
+        if (!map_stdin(m))
+            return parallel_stdin_palindrome(n_threads, substrings);
+        Pali p = parallel_longest_palindrome(m.begin, m.end, n_threads, substrings);
+        max_pali.assign(m.begin + p.pos, p.len);
+        unmap_stdin(m);
+        return max_pali;
     }
+    for_each_word([&](std::string_view word) {
+        if (word.size() <= max_pali.size())
+            return;
+        Pali p = palindrome_in_word(word, max_pali.size(), substrings);
+        if (p.len > max_pali.size())
+            max_pali.assign(word.substr(p.pos, p.len));
+    });
     return max_pali;
 }
 
-int main()
+// usage: fast-pali [-t n_threads] [-s word|stream] < input
+//    -s word   = longest palindromic substring inside any word
+//    -s stream = longest palindromic substring of the whole input
+int main(int argc, char **argv)
 {
-    std::string max_pali = get_longest_palindrome();
+    int n_threads = 1;
+    Search search = Search::Words;
+    int opt;
+    while ((opt = getopt(argc, argv, "t:s:")) != -1)
+    {
+        if (opt == 't' && atoi(optarg) > 0)
+            n_threads = atoi(optarg);
+        else if (opt == 's' && strcmp(optarg, "word") == 0)
+            search = Search::Substrings;
+        else if (opt == 's' && strcmp(optarg, "stream") == 0)
+            search = Search::Stream;
+        else
+        {
+            fprintf(stderr, "usage: %s [-t n_threads] [-s word|stream] < input\n", argv[0]);
+            return 1;
+        }
+    }
+    std::string max_pali = get_longest_palindrome(n_threads, search);
     printf("Longest palindrome: %s\n", max_pali.c_str());
     return 0;
 }
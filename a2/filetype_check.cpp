@@ -0,0 +1,70 @@
+// compares get_file_type() with file(1) over a directory tree
+//
+// build: g++ -O2 -pthread -o filetype_check filetype_check.cpp getDirStats.cpp
+// usage: ./filetype_check dir
+//
+// for every file below dir (symlinks are left out, getDirStats() types those
+// from their target name) it runs "file -b" and cuts its output at the first
+// ',' like the old popen() code did, then prints the files where the two
+// differ as
+//         path <TAB> get_file_type() <TAB> file(1)
+// and a summary on stderr; exits with 1 if anything differed
+
+#include "getDirStats.h"
+
+#include <fcntl.h>
+#include <ftw.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <string>
+#include <vector>
+
+static long n_checked = 0, n_differ = 0;
+
+// first field of "file -b path"
+static std::string file_type(const char * path) {
+    std::string cmd = "file -b -- '";
+    for (const char * p = path; *p; p++) {
+        if (*p == '\'') cmd += "'\\''";
+        else cmd += *p;
+    }
+    cmd += "'";
+    FILE * fp = popen(cmd.c_str(), "r");
+    if (fp == nullptr) return "popen() failed";
+    char buff[4096];
+    std::string res = fgets(buff, sizeof(buff), fp) ? buff : "";
+    pclose(fp);
+    return res.substr(0, res.find_first_of(",\n"));
+}
+
+static int check(const char * path, const struct stat * st, int flag, struct FTW *) {
+    if (flag == FTW_SL || flag == FTW_SLN || flag == FTW_NS) return 0;
+    // as much of the head as getDirStats() reads (SNIFF_SIZE)
+    std::vector<unsigned char> head(64 * 1024);
+    int fd = S_ISREG(st->st_mode) ? open(path, O_RDONLY) : -1;
+    ssize_t n = fd >= 0 ? pread(fd, head.data(), head.size(), 0) : 0;
+    std::string mine = get_file_type(*st, fd, head.data(), n > 0 ? n : 0);
+    if (fd >= 0) close(fd);
+    std::string theirs = file_type(path);
+    n_checked++;
+    if (mine != theirs) {
+        n_differ++;
+        printf("%s\t%s\t%s\n", path, mine.c_str(), theirs.c_str());
+    }
+    return 0;
+}
+
+int main(int argc, char ** argv) {
+    if (argc != 2) {
+        fprintf(stderr, "usage: %s dir\n", argv[0]);
+        return 2;
+    }
+    if (nftw(argv[1], check, 64, FTW_PHYS) != 0) {
+        perror(argv[1]);
+        return 2;
+    }
+    fprintf(stderr, "%ld files, %ld differ from file(1)\n", n_checked, n_differ);
+    return n_differ != 0;
+}
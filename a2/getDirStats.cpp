@@ -1,248 +1,3183 @@
-#include "getDirStats.h"
-#include "digester.h"
-
-#include <dirent.h>
-#include <stdio.h>
-#include <sys/stat.h>
-#include <sys/types.h>
-#include <unistd.h>
-#include <unordered_map>
-#include <algorithm>
-#include <set>
-#include <cstring>
-
-std::unordered_map<std::string,int> words_hist;
-std::unordered_map<std::string,int> types_hist;
-std::unordered_map<std::string,std::vector<std::string>> hash_hist;
-constexpr int MAX_WORD_SIZE = 1024;
-
-int
-get_file_size(const std::string & path) {
-    struct stat stats;
-    if(stat(path.c_str(), &stats) == -1) { //stores stuff in stats structure
-        printf("ERROR OBTAINING STATS");
-        exit(1);
-    }
-    else 
-        return (int)stats.st_size;
-}
-
-//CODE SNIPPET MODIFIED FROM https://gitlab.com/cpsc457/public/popen-example/
-std::string
-get_file_type(const std::string & path) {
-    std::string cmd = "file -b " + path;
-    FILE * fp = popen( cmd.c_str(), "r");
-    if( fp == nullptr) {
-        printf("popen() failed, quitting\n");
-        exit(-1);
-    }
-
-    std::string ftype;
-    char buff[4096];
-    char * res = fgets(buff, sizeof(buff), fp);
-    pclose(fp);
-    // try to parse the buffer
-    if( res != nullptr) {
-        // find the end of the first field ('\0', or '\n' or ',')
-        int eol = 0;
-        while(buff[eol] != ',' && buff[eol] != '\n' && buff[eol] != 0) eol ++;
-        // terminate the string
-        buff[eol] = 0;
-        // remember the type
-        ftype = buff;
-    } else {
-        // file(1) did not produce any output... no idea why, so let's
-        // just skip the file, but make the file type something bizare
-        ftype = "file(1) failed, not sure why";
-    }
-    return ftype;
-}
-
-//CODE SNIPPET MODIFIED FROM https://gitlab.com/cpsc457/public/word-histogram
-// returns the next word from stdin
-//     - word is a sequence of characters [a-zA-Z]
-//     - the word is converted into lower case
-//     - words are separated by any non alphabetic characters
-//     - return empty string on EOF
-//    example:
-//     "     Hello..    World:) !" --> ["hello", "world", ""]
-std::string
-next_word(FILE* fp)
-{
-    std::string result;
-    while(1) {
-        int c = fgetc(fp); //MODIFIED LINE - reads char by char from file pointer
-        if(c == EOF) break;
-        c = tolower(c);
-        if(! isalpha(c)) {
-            if(result.size() == 0)
-            continue;
-            else
-            break;
-        }
-        else {
-            if(result.size() >= MAX_WORD_SIZE) {
-            printf("input exceeded %d word size, aborting...\n", MAX_WORD_SIZE);
-            exit(-1);
-            }
-            result.push_back(c);
-        }
-    }
-    return result;
-}
-
-static bool is_dir(const std::string & path)
-{
-    struct stat buff;
-    if (0 != stat(path.c_str(), &buff)) return false;
-    return S_ISDIR(buff.st_mode);
-}
-
-
-// getDirStats() computes stats about directory a directory
-//         root_dir = name of the directory to examine
-//         n = how many top words/filet types/groups to report
-
-Results getDirStats(const std::string & root_dir, int n)
-{
-    Results res;
-    //initializes values
-    res.all_files_size = 0;
-    res.n_files = 0;
-    res.n_dirs = 0;
-    res.largest_file_path = ""; //defaults to empty string if no files
-    res.largest_file_size = -1; //defaults to -1 if no files
-
-    if (! is_dir(root_dir)) return res; // if input directory isn't correct, returns empty results
-
-    // FOLLOWING SNIPPET MODIFIED FROM
-    // https://gitlab.com/cpsc457/public/find-empty-directories/-/blob/master/myfind.cpp
-    // SNIPPET Recursively examines a directory, finding and printing all files
-    std::vector<std::string> stack;
-    stack.push_back(root_dir.c_str()); //adds base directory to stack to start
-    while (! stack.empty()) {
-        auto dirname = stack.back();
-        stack.pop_back();
-
-        printf("%s\n", dirname.c_str());
-        if(is_dir(dirname)) { //if the current name is a directory and not a file
-            if(strcmp(root_dir.c_str(), dirname.c_str()) != 0) //explicit!
-                res.n_dirs++; //increments directory counter
-        }
-        else //if the current name is a file, we need to obtain all needed info
-        {
-            
-            res.n_files++; //increments file counter
-
-            FILE* fp;
-            fp = fopen(dirname.c_str(), "r"); //opens file for reading
-
-            if(fp != NULL) { //if the file pointer's valid, let's read it
-                //reads all words in file and stores in words_hist
-                while(1) {
-                    auto w = next_word(fp);
-                    if(w.size() == 0) //if there are no more words, break the loop
-                        break;
-                    else if(w.size() >= 3) //if word is 3 chars or greater (requirement), adds it to the histogram
-                        words_hist[w] ++;
-                }
-                fclose(fp); //closes the file when we're done
-            }
-            else {
-                printf("ERROR: Couldn't read file\n"); //shouldn't happen
-            }
-
-            //check file size - add to total sum, check if largest
-            int bytes = get_file_size(dirname);
-            res.all_files_size += bytes; //adds size to total sum
-            if(bytes > res.largest_file_size) { //if it's larger, we record it
-                res.largest_file_size = bytes;
-                res.largest_file_path = dirname;
-            }
-
-            //use popen file utility to obtain file type
-            std::string ftype = get_file_type(dirname);
-            types_hist[ftype]++; //adds a count to the file type hashmap
-
-            //calculate hash
-            std::string hash = sha256_from_file(dirname);
-            if(hash_hist.count(hash)) { //if the hash is already in the histogram
-                hash_hist[hash].push_back(dirname); //add the file name to the list of duplicates
-            }
-            else { //otherwise this is the first occurence
-                std::vector<std::string> filevect;
-                filevect.push_back(dirname); //make and put a name in a vector
-                hash_hist[hash] = filevect; //and put the vector in the hashmap
-            }
-            
-        }
-
-        //opens directory stream and uses it to navigate to other files/directories within the current directory
-        DIR * dir = opendir(dirname.c_str());
-        if (dir) {
-            while (1) {
-                dirent * de = readdir(dir);
-                if (! de) break;
-                std::string name = de->d_name;
-                if (name == "." || name == "..") continue;
-                std::string path = dirname + "/" + de->d_name;
-                stack.push_back(path);
-            }
-            closedir(dir);
-        }
-    }
-
-    //We have gathered all the information, now we need to process it
-    //most common words and types need to be sorted and cropped
-
-    // first we place the words and counts into array (with count
-    // negative to reverse the sort)
-    std::vector<std::pair<int,std::string>> arr1;
-    for(auto & h : words_hist)
-        arr1.emplace_back(-h.second, h.first);
-    // if we have more than N entries, we'll sort partially, since
-    // we only need the first N to be sorted
-    if(arr1.size() > size_t(n)) {
-        std::partial_sort(arr1.begin(), arr1.begin() + n, arr1.end());
-        // drop all entries after the first n
-        arr1.resize(n);
-    } else {
-        std::sort(arr1.begin(), arr1.end());
-    }
-    //now we insert these into the results vector
-    for(auto & p : arr1) {
-        res.most_common_words.emplace_back(p.second, -p.first);
-    }
-
-    std::vector<std::pair<int,std::string>> arr2;
-    for(auto & h : types_hist)
-        arr2.emplace_back(-h.second, h.first);
-    // if we have more than N entries, we'll sort partially, since
-    // we only need the first N to be sorted
-    if(arr2.size() > size_t(n)) {
-        std::partial_sort(arr2.begin(), arr2.begin() + n, arr2.end());
-        // drop all entries after the first n
-        arr2.resize(n);
-    } else {
-        std::sort(arr2.begin(), arr2.end());
-    }
-    //now we insert these into the results vector
-    for(auto & p : arr2) {
-        res.most_common_types.emplace_back(p.second, -p.first);
-    }
-    
-    //duplicates - uses second approach
-    std::set<std::pair<int,std::vector<std::string>>> mmq; //min/max queue
-    for(auto & h : hash_hist) {
-        if(h.second.size() > 1) //if duplicates were found
-            mmq.emplace(-(h.second.size()), h.second); //puts in a pair that includes the # of duplicates and the array of file names
-        if(mmq.size() > size_t(n)) //if the queue is too big, dump the lowest
-            mmq.erase(std::prev(mmq.end()));
-    } 
-    for(auto & v : mmq) { //pulls just the string vectors and puts them in the duplicate files
-        res.duplicate_files.push_back(v.second);
-    }
-    
-    //everything done!!!
-    return res;
-}
\ No newline at end of file
+#include "getDirStats.h"
+
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <ctype.h>
+#include <stdint.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <sys/sysmacros.h>
+#include <sys/resource.h>
+#include <sys/syscall.h>
+#include <sys/inotify.h>
+#include <sys/eventfd.h>
+#include <poll.h>
+#include <linux/io_uring.h>
+#include <unistd.h>
+#include <unordered_map>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <set>
+#include <string_view>
+#include <tuple>
+#include <thread>
+#include <cstring>
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define DIRSTATS_X86_DISPATCH
+#include <cpuid.h>
+#include <immintrin.h>
+#endif
+
+constexpr int MAX_WORD_SIZE = 1024;
+
+// -----------------------------------------------------------------------------
+// file type detection
+//
+// replaces running "file -b" through popen() for every file: the first
+// SNIFF_SIZE bytes of the file are checked against a compiled table of the
+// signatures file(1) knows for common types, then against the text checks
+// it does (encoding, scripts, markup, C sources)
+// the result is the first field of what file(1) would print, i.e. the same
+// string the old popen() code cut out of its output
+constexpr size_t SNIFF_SIZE = 64 * 1024;
+
+// fixed signatures at fixed offsets
+struct Magic {
+    size_t offset;
+    const char * bytes;
+    size_t len;
+    const char * type;
+};
+#define MAGIC(off, str, type) { off, str, sizeof(str) - 1, type }
+static const Magic magic_table[] = {
+    MAGIC(0, "\x89PNG\r\n\x1a\n", "PNG image data"),
+    MAGIC(0, "GIF87a", "GIF image data"),
+    MAGIC(0, "GIF89a", "GIF image data"),
+    MAGIC(0, "\xff\xd8\xff", "JPEG image data"),
+    MAGIC(0, "%PDF-", "PDF document"),
+    MAGIC(0, "\xde\x12\x04\x95", "GNU message catalog (little endian)"),
+    MAGIC(0, "\x95\x04\x12\xde", "GNU message catalog (big endian)"),
+    MAGIC(0, "{\\rtf", "Rich Text Format data"),
+    MAGIC(0, "\x1f\x8b", "gzip compressed data"),
+    MAGIC(0, "BZh", "bzip2 compressed data"),
+    MAGIC(0, "\xfd" "7zXZ\0", "XZ compressed data"),
+    MAGIC(0, "\x28\xb5\x2f\xfd", "Zstandard compressed data (v0.8+)"),
+    MAGIC(0, "7z\xbc\xaf\x27\x1c", "7-zip archive data"),
+    MAGIC(0, "!<arch>\n", "current ar archive"),
+    MAGIC(0, "OggS", "Ogg data"),
+    MAGIC(0, "\xd0\xcf\x11\xe0\xa1\xb1\x1a\xe1", "Composite Document File V2 Document"),
+    MAGIC(257, "ustar  \0", "POSIX tar archive (GNU)"),
+    MAGIC(257, "ustar\0", "POSIX tar archive"),
+    MAGIC(4, "ftyp", "ISO Media"),
+    MAGIC(0, "-----BEGIN CERTIFICATE-----", "PEM certificate"),
+    MAGIC(0, "-----BEGIN CERTIFICATE REQUEST-----", "PEM certificate request"),
+    MAGIC(0, "-----BEGIN PGP PUBLIC KEY BLOCK-", "PGP public key block Public-Key (old)"),
+    MAGIC(0, "-----BEGIN PGP SIGNATURE-", "PGP signature Signature (old)"),
+    MAGIC(0, "-----BEGIN PGP MESSAGE-", "PGP message Public-Key Encrypted Session Key (old)"),
+};
+#undef MAGIC
+
+// how file(1) classifies bytes when deciding whether something is text
+//    F = never appears in text, T = plain ASCII text
+//    I = ISO-8859 text, X = non-ISO extended ASCII
+enum { F = 0, T = 1, I = 2, X = 3 };
+static const unsigned char text_chars[256] = {
+    F, F, F, F, F, F, F, T, T, T, T, T, T, T, F, F, // 0x0X, BEL BS HT LF VT FF CR
+    F, F, F, F, F, F, F, F, F, F, F, T, F, F, F, F, // 0x1X, ESC
+    T, T, T, T, T, T, T, T, T, T, T, T, T, T, T, T, // 0x2X
+    T, T, T, T, T, T, T, T, T, T, T, T, T, T, T, T, // 0x3X
+    T, T, T, T, T, T, T, T, T, T, T, T, T, T, T, T, // 0x4X
+    T, T, T, T, T, T, T, T, T, T, T, T, T, T, T, T, // 0x5X
+    T, T, T, T, T, T, T, T, T, T, T, T, T, T, T, T, // 0x6X
+    T, T, T, T, T, T, T, T, T, T, T, T, T, T, T, F, // 0x7X, DEL
+    X, X, X, X, X, T, X, X, X, X, X, X, X, X, X, X, // 0x8X, NEL
+    X, X, X, X, X, X, X, X, X, X, X, X, X, X, X, X, // 0x9X
+    I, I, I, I, I, I, I, I, I, I, I, I, I, I, I, I, // 0xaX
+    I, I, I, I, I, I, I, I, I, I, I, I, I, I, I, I, // 0xbX
+    I, I, I, I, I, I, I, I, I, I, I, I, I, I, I, I, // 0xcX
+    I, I, I, I, I, I, I, I, I, I, I, I, I, I, I, I, // 0xdX
+    I, I, I, I, I, I, I, I, I, I, I, I, I, I, I, I, // 0xeX
+    I, I, I, I, I, I, I, I, I, I, I, I, I, I, I, I, // 0xfX
+};
+
+// true if b[0..n) is valid UTF-8 made of text characters
+static bool looks_utf8(const unsigned char * b, size_t n) {
+    for (size_t i = 0; i < n; ) {
+        unsigned char c = b[i];
+        if (c < 0x80) {
+            if (text_chars[c] != T) return false;
+            i++;
+            continue;
+        }
+        int follow;
+        if ((c & 0xe0) == 0xc0) follow = 1;
+        else if ((c & 0xf0) == 0xe0) follow = 2;
+        else if ((c & 0xf8) == 0xf0) follow = 3;
+        else return false;
+        if (i + follow >= n) return true; // sequence cut off by the end of the buffer
+        for (int k = 1; k <= follow; k++)
+            if ((b[i + k] & 0xc0) != 0x80) return false;
+        i += follow + 1;
+    }
+    return true;
+}
+
+// returns the text encoding file(1) would report, or "" for binary data
+static std::string text_encoding(const unsigned char * b, size_t n) {
+    if (n >= 2 && ((b[0] == 0xff && b[1] == 0xfe) || (b[0] == 0xfe && b[1] == 0xff)))
+        return "Unicode text"; // UTF-16 with a byte order mark
+    int worst = T;
+    for (size_t i = 0; i < n; i++) {
+        int c = text_chars[b[i]];
+        if (c == F) return "";
+        worst = std::max(worst, c);
+    }
+    if (worst == T) return "ASCII text";
+    if (looks_utf8(b, n)) return "Unicode text";
+    if (worst == I) return "ISO-8859 text";
+    return "Non-ISO extended-ASCII text";
+}
+
+// minimal JSON validator, file(1) only calls it JSON when the whole file
+// parses and the top level is an object or array
+struct JsonParser {
+    const unsigned char * p, * end;
+    int depth = 0;
+    void ws() { while (p < end && (*p == ' ' || *p == '\t' || *p == '\n' || *p == '\r')) p++; }
+    bool lit(const char * s) {
+        size_t l = strlen(s);
+        if (size_t(end - p) < l || memcmp(p, s, l) != 0) return false;
+        p += l;
+        return true;
+    }
+    bool str() {
+        if (p >= end || *p != '"') return false;
+        for (p++; p < end; p++) {
+            if (*p == '"') { p++; return true; }
+            if (*p == '\\' && ++p >= end) return false;
+            if (*p < 0x20) return false;
+        }
+        return false;
+    }
+    bool num() {
+        const unsigned char * s = p;
+        if (p < end && *p == '-') p++;
+        while (p < end && (isdigit(*p) || *p == '.' || *p == 'e' || *p == 'E' || *p == '+' || *p == '-')) p++;
+        return p > s && isdigit(p[-1]);
+    }
+    bool value() {
+        ws();
+        if (p >= end || ++depth > 256) return false;
+        bool ok;
+        if (*p == '{' || *p == '[') {
+            char close = *p == '{' ? '}' : ']';
+            p++;
+            ws();
+            ok = true;
+            if (p < end && *p == close) p++;
+            else while (1) {
+                if (close == '}') {
+                    ws();
+                    if (!str()) { ok = false; break; }
+                    ws();
+                    if (p >= end || *p++ != ':') { ok = false; break; }
+                }
+                if (!value()) { ok = false; break; }
+                ws();
+                if (p < end && *p == ',') { p++; continue; }
+                ok = p < end && *p++ == close;
+                break;
+            }
+        }
+        else if (*p == '"') ok = str();
+        else if (*p == 't') ok = lit("true");
+        else if (*p == 'f') ok = lit("false");
+        else if (*p == 'n') ok = lit("null");
+        else ok = num();
+        depth--;
+        return ok;
+    }
+};
+
+static bool looks_json(const unsigned char * b, size_t n) {
+    JsonParser j { b, b + n };
+    j.ws();
+    if (j.p >= j.end || (*j.p != '{' && *j.p != '[')) return false;
+    if (!j.value()) return false;
+    j.ws();
+    return j.p == j.end;
+}
+
+// "#!" line -> script type, keyed by the interpreter's name
+static std::string script_type(const unsigned char * b, size_t n) {
+    std::string line((const char *) b + 2, std::find(b + 2, b + n, '\n') - (b + 2));
+    auto trim = [](std::string s) {
+        size_t a = s.find_first_not_of(" \t\r"), z = s.find_last_not_of(" \t\r");
+        return a == std::string::npos ? std::string() : s.substr(a, z - a + 1);
+    };
+    line = trim(line);
+    std::string interp = line.substr(0, line.find_first_of(" \t"));
+    std::string args = trim(line.substr(interp.size()));
+    bool env = interp.size() >= 4 && interp.compare(interp.size() - 4, 4, "/env") == 0;
+    if (env) {
+        // the real interpreter is the next word
+        interp = args.substr(0, args.find_first_of(" \t"));
+        line = args;
+    }
+    std::string name = interp.substr(interp.rfind('/') + 1);
+    if (!env && interp == "/bin/sh") return "POSIX shell script";
+    if (name == "bash") return "Bourne-Again shell script";
+    if (name.compare(0, 6, "python") == 0) return "Python script";
+    if (name == "perl") return "Perl script text executable";
+    if (name == "ruby") return "Ruby script";
+    if (name == "node") return "Node.js script executable";
+    if (name == "php") return "PHP script";
+    if (name == "zsh") return "Paul Falstad's zsh script";
+    if (name == "ksh") return "Korn shell script";
+    if (name == "csh") return "C shell script";
+    if (name == "tcsh") return "Tenex C shell script";
+    if (name == "tclsh" || name == "wish") return "Tcl/Tk script";
+    if (name == "awk" || name == "gawk" || name == "nawk") return "awk script";
+    if (name == "lua") return "Lua script";
+    return "a " + line + " script";
+}
+
+// source code heuristics, like file(1) these look at how lines start in
+// the first 8KB
+static std::string source_type(const unsigned char * b, size_t n) {
+    n = std::min<size_t>(n, 8192);
+    bool c = false, cpp = false, ifdef = false;
+    for (size_t i = 0; i < n; ) {
+        size_t e = std::find(b + i, b + n, '\n') - b;
+        std::string l((const char *) b + i, e - i);
+        i = e + 1;
+        size_t last = l.find_last_not_of(" \t\r");
+        if (last == std::string::npos) continue;
+        char end = l[last];
+        auto starts = [&](const char * s) { return l.compare(0, strlen(s), s) == 0; };
+        // some preprocessor lines may have spaces after the '#'
+        std::string pp;
+        if (l[0] == '#') {
+            size_t k = l.find_first_not_of(" \t", 1);
+            if (k != std::string::npos) pp = l.substr(k, l.find_first_of(" \t", k) - k);
+        }
+        std::string stripped = l.substr(l.find_first_not_of(" \t"));
+
+        if ((starts("class ") || stripped.compare(0, 4, "def ") == 0) && end == ':') return "Python script";
+        if (starts("from ") && l.find(" import ") != std::string::npos) return "Python script";
+        if (stripped.compare(0, 9, "require '") == 0
+            && stripped[std::min(stripped.size() - 1, stripped.find_first_not_of("abcdefghijklmnopqrstuvwxyzABCDEFGHIJKLMNOPQRSTUVWXYZ_/.", 9))] == '\'')
+            return "Ruby script";
+        if (starts("package ") && end == ';' && l.find_first_not_of("abcdefghijklmnopqrstuvwxyzABCDEFGHIJKLMNOPQRSTUVWXYZ0123456789_: ;", 8) == std::string::npos)
+            return "Perl5 module source";
+        if (starts("CFLAGS") || starts("LDFLAGS") || starts("VPATH") || starts("all:") || starts(".PRECIOUS") || starts("SUBDIRS"))
+            return "makefile script";
+
+        if (starts("'use strict'") || starts("\"use strict\"") || starts("module.exports")
+            || (starts("function ") && end == '{'))
+            return "JavaScript source";
+        if (starts("import ") && end == ';') return "Java source";
+
+        if (starts("class ") || starts("template") || (starts("virtual ") && l.find('(') != std::string::npos)
+            || starts("using std::") || starts("public:") || starts("private:") || starts("protected:")
+            || (starts("namespace ") && !starts("namespace eval")))
+            cpp = true;
+        if (starts("#include") || pp == "pragma" || starts("struct ") || starts("int main(")
+            || (starts("char ") && end == ';'))
+            c = true;
+        if (pp == "ifdef" || pp == "ifndef") ifdef = true;
+        if (ifdef && (pp == "define" || pp == "endif")) c = true;
+    }
+    if (cpp) return "C++ source";
+    if (c) return "C source";
+    return "";
+}
+
+// unified diffs, the way file(1)'s magic finds them: the first "--- " starts
+// in the first 4KB, and the next line starts with "+++ " and the one after
+// with "@@" (either may also start one byte into its line), each newline at
+// most 1KB after the match before it
+static bool looks_unified_diff(const unsigned char * b, size_t n) {
+    std::string_view s((const char *) b, n);
+    auto at = [&s](size_t off, std::string_view t) { return off <= s.size() && s.substr(off, t.size()) == t; };
+    size_t p = s.find("--- ");
+    if (p == std::string_view::npos || p > 4096) return false;
+    p += 4;
+    for (std::string_view next : { "+++ ", "@@" }) {
+        size_t nl = s.find('\n', p);
+        if (nl == std::string_view::npos || nl - p > 1024) return false;
+        if (at(nl + 1, next)) p = nl + 1 + next.size();
+        else if (at(nl + 2, next)) p = nl + 2 + next.size();
+        else return false;
+    }
+    return true;
+}
+
+// ELF headers, fields are read in the file's own byte order
+static std::string elf_type(int fd, const unsigned char * b, size_t n) {
+    if (n < 64) return "ELF";
+    bool is64 = b[4] == 2, msb = b[5] == 2;
+    auto rd = [msb](const unsigned char * p, int len) {
+        uint64_t v = 0;
+        for (int i = 0; i < len; i++) v |= uint64_t(p[msb ? len - 1 - i : i]) << (8 * i);
+        return v;
+    };
+    std::string res = std::string("ELF ") + (is64 ? "64-bit " : "32-bit ") + (msb ? "MSB " : "LSB ");
+    switch (rd(b + 16, 2)) {
+    case 1: return res + "relocatable";
+    case 2: return res + "executable";
+    case 4: return res + "core file";
+    case 3: break;
+    default: return res + "unknown type";
+    }
+    // ET_DYN is a PIE when the dynamic section has DF_1_PIE in DT_FLAGS_1
+    uint64_t phoff = rd(b + (is64 ? 32 : 28), is64 ? 8 : 4);
+    uint64_t phentsize = rd(b + (is64 ? 54 : 42), 2), phnum = rd(b + (is64 ? 56 : 44), 2);
+    for (uint64_t i = 0; i < phnum; i++) {
+        uint64_t off = phoff + i * phentsize;
+        if (off + (is64 ? 56 : 32) > n) break;
+        const unsigned char * ph = b + off;
+        if (rd(ph, 4) != 2) continue; // PT_DYNAMIC
+        uint64_t doff = rd(ph + (is64 ? 8 : 4), is64 ? 8 : 4);
+        uint64_t dsize = std::min<uint64_t>(rd(ph + (is64 ? 32 : 16), is64 ? 8 : 4), SNIFF_SIZE);
+        std::vector<unsigned char> dyn(dsize);
+        ssize_t got = pread(fd, dyn.data(), dsize, doff);
+        size_t entsize = is64 ? 16 : 8, half = entsize / 2;
+        for (ssize_t k = 0; k + (ssize_t) entsize <= got; k += entsize) {
+            uint64_t tag = rd(&dyn[k], half);
+            if (tag == 0) break;
+            if (tag == 0x6ffffffb && (rd(&dyn[k + half], half) & 0x08000000))
+                return res + "pie executable";
+        }
+        break;
+    }
+    return res + "shared object";
+}
+
+// MZ executables, PE ones are described by their optional header
+static std::string pe_type(const unsigned char * b, size_t n) {
+    if (n < 0x40) return "MS-DOS executable";
+    uint32_t pe = b[0x3c] | b[0x3d] << 8 | b[0x3e] << 16 | uint32_t(b[0x3f]) << 24;
+    if (uint64_t(pe) + 24 + 70 > n || memcmp(b + pe, "PE\0\0", 4) != 0) return "MS-DOS executable";
+    auto u16 = [b](size_t o) { return b[o] | b[o + 1] << 8; };
+    int machine = u16(pe + 4), flags = u16(pe + 22), magic = u16(pe + 24), subsys = u16(pe + 24 + 68);
+    std::string res = magic == 0x20b ? "PE32+ executable" : "PE32 executable";
+    if (flags & 0x2000) res += " (DLL)";
+    if (subsys == 2) res += " (GUI)";
+    else if (subsys == 3) res += " (console)";
+    if (machine == 0x14c) res += " Intel 80386";
+    else if (machine == 0x8664) res += " x86-64";
+    else if (machine == 0xaa64) res += " Aarch64";
+    return res;
+}
+
+// file type from the contents of a regular file
+//    fd   = open file, used only for the few types that need more than the header
+//    b, n = first bytes of the file (up to SNIFF_SIZE)
+//    size = size of the whole file
+static std::string sniff_file_type(int fd, const unsigned char * b, size_t n, int64_t size) {
+    auto at = [b, n](size_t off, const char * s, size_t len) {
+        return off + len <= n && memcmp(b + off, s, len) == 0;
+    };
+    if (at(0, "\x7f" "ELF", 4)) return elf_type(fd, b, n);
+    if (at(0, "MZ", 2)) return pe_type(b, n);
+    if (at(0, "PK\x03\x04", 4)) {
+        // jar files start with their manifest directory
+        if (n >= 30 && at(30, "META-INF/", 9)) return "Java archive data (JAR)";
+        return "Zip archive data";
+    }
+    if (at(0, "RIFF", 4)) return "RIFF (little-endian) data";
+    if (n >= 4 && b[2] == '\r' && b[3] == '\n') {
+        // byte-compiled python, the first two bytes identify the version
+        static const struct { int lo, hi; const char * ver; } pyc[] = {
+            { 3360, 3379, "3.6" }, { 3390, 3399, "3.7" }, { 3400, 3419, "3.8" }, { 3420, 3429, "3.9" },
+            { 3430, 3449, "3.10" }, { 3450, 3499, "3.11" }, { 3500, 3549, "3.12" }, { 3550, 3599, "3.13" },
+        };
+        int magic = b[0] | b[1] << 8;
+        for (auto & v : pyc)
+            if (magic >= v.lo && magic <= v.hi)
+                return std::string("Byte-compiled Python module for CPython ") + v.ver;
+    }
+    if (at(0, "TZif", 4) && n >= 44) {
+        // version 2+ files keep a v1 block, "slim" ones leave it nearly empty
+        if (b[4] == 0) return "timezone data";
+        auto cnt = [b](int k) { return uint32_t(b[20 + 4 * k]) << 24 | b[21 + 4 * k] << 16 | b[22 + 4 * k] << 8 | b[23 + 4 * k]; };
+        bool slim = cnt(0) == 0 && cnt(1) == 0 && cnt(2) == 0 && cnt(3) == 0 && cnt(4) <= 1 && cnt(5) <= 1;
+        return slim ? "timezone data (slim)" : "timezone data (fat)";
+    }
+    if (at(0, "%!PS", 4)) {
+        std::string res = "PostScript document text";
+        if (at(4, "-Adobe-", 7)) {
+            const unsigned char * v = b + 11, * e = v;
+            while (e < b + n && !isspace(*e)) e++;
+            res += " conforming DSC level " + std::string((const char *) v, e - v);
+        }
+        return res;
+    }
+    if (at(0, "ID3", 3) && n >= 5)
+        return "Audio file with ID3 version 2." + std::to_string(b[3]) + "." + std::to_string(b[4]);
+    for (auto & m : magic_table)
+        if (at(m.offset, m.bytes, m.len)) return m.type;
+
+    std::string enc = text_encoding(b, n);
+    if (enc.empty()) return "data";
+    if (int64_t(n) == size && looks_json(b, n)) return "JSON text data";
+    if (at(0, "#!", 2)) return script_type(b, n);
+    if (looks_unified_diff(b, n)) return "unified diff output";
+    // markup is searched for anywhere in the first 4KB, ignoring case
+    std::string head((const char *) b, std::min<size_t>(n, 4096));
+    for (auto & c : head) c = tolower(c);
+    bool svg = head.find("<svg") != std::string::npos;
+    if (at(0, "<?xml version=", 14) && n >= 18)
+        return svg ? "SVG Scalable Vector Graphics image" : "XML " + std::string((const char *) b + 15, 3) + " document";
+    for (auto tag : { "<!doctype html", "<html", "<head", "<title", "<body" })
+        if (head.find(tag) != std::string::npos) return "HTML document";
+    if (head.compare(0, 9, "<!doctype") == 0) return "exported SGML document";
+    if (svg) return "SVG Scalable Vector Graphics image";
+    std::string src = source_type(b, n);
+    if (!src.empty()) return src;
+    return enc;
+}
+
+// type of a symbolic link, file(1) does not follow those and prints
+// non-ASCII bytes of the target in octal
+static std::string symlink_type(int dir_fd, const char * name, bool broken) {
+    char target[4096];
+    ssize_t len = readlinkat(dir_fd, name, target, sizeof(target));
+    std::string res = broken ? "broken symbolic link to " : "symbolic link to ";
+    for (ssize_t i = 0; i < len; i++) {
+        unsigned char ch = target[i];
+        if (ch >= 0x80 || ch < 0x20) {
+            char oct[5];
+            snprintf(oct, sizeof(oct), "\\%03o", ch);
+            res += oct;
+        }
+        else res += ch;
+    }
+    return res.substr(0, res.find(','));
+}
+
+// returns the type of a file that is not a symlink, the same as the first
+// field of what "file -b" prints
+//    st   = stat() of the file
+//    fd   = the file opened for reading, or -1 if that failed
+//    b, n = the first bytes of the file
+std::string
+get_file_type(const struct stat & st, int fd, const unsigned char * b, size_t n) {
+    if (S_ISDIR(st.st_mode)) return "directory";
+    if (S_ISFIFO(st.st_mode)) return "fifo (named pipe)";
+    if (S_ISSOCK(st.st_mode)) return "socket";
+    if (S_ISCHR(st.st_mode) || S_ISBLK(st.st_mode))
+        return std::string(S_ISCHR(st.st_mode) ? "character" : "block") + " special ("
+            + std::to_string(major(st.st_rdev)) + "/" + std::to_string(minor(st.st_rdev)) + ")";
+    if (fd < 0) return "regular file"; // no read permission
+    if (st.st_size == 0) return "empty";
+    if (st.st_size == 1) return "very short file (no magic)";
+    return sniff_file_type(fd, b, n, st.st_size);
+}
+
+// -----------------------------------------------------------------------------
+// SHA-256 (FIPS 180-4), digests are printed as lowercase hex like
+// sha256_from_file() does
+//
+// the compression function comes in three kernels: SHA-NI for one stream,
+// AVX2 for 8 independent streams at once (one per 32-bit lane, see
+// Sha256x8), and plain C for everything else
+static const uint32_t sha256_k[64] = {
+    0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5, 0x3956c25b, 0x59f111f1, 0x923f82a4, 0xab1c5ed5,
+    0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3, 0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174,
+    0xe49b69c1, 0xefbe4786, 0x0fc19dc6, 0x240ca1cc, 0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+    0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7, 0xc6e00bf3, 0xd5a79147, 0x06ca6351, 0x14292967,
+    0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13, 0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85,
+    0xa2bfe8a1, 0xa81a664b, 0xc24b8b70, 0xc76c51a3, 0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+    0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5, 0x391c0cb3, 0x4ed8aa4a, 0x5b9cca4f, 0x682e6ff3,
+    0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208, 0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2,
+};
+static const uint32_t sha256_init[8] = {
+    0x6a09e667, 0xbb67ae85, 0x3c6ef372, 0xa54ff53a, 0x510e527f, 0x9b05688c, 0x1f83d9ab, 0x5be0cd19,
+};
+
+static uint32_t rotr(uint32_t x, int n) { return (x >> n) | (x << (32 - n)); }
+
+// compresses n 64-byte blocks into the state h
+static void sha256_blocks_scalar(uint32_t h[8], const unsigned char * p, size_t n) {
+    for (; n > 0; n--, p += 64) {
+        uint32_t w[64];
+        for (int i = 0; i < 16; i++)
+            w[i] = uint32_t(p[4 * i]) << 24 | p[4 * i + 1] << 16 | p[4 * i + 2] << 8 | p[4 * i + 3];
+        for (int i = 16; i < 64; i++) {
+            uint32_t s0 = rotr(w[i - 15], 7) ^ rotr(w[i - 15], 18) ^ (w[i - 15] >> 3);
+            uint32_t s1 = rotr(w[i - 2], 17) ^ rotr(w[i - 2], 19) ^ (w[i - 2] >> 10);
+            w[i] = w[i - 16] + s0 + w[i - 7] + s1;
+        }
+        uint32_t a = h[0], b = h[1], c = h[2], d = h[3], e = h[4], f = h[5], g = h[6], hh = h[7];
+        for (int i = 0; i < 64; i++) {
+            uint32_t t1 = hh + (rotr(e, 6) ^ rotr(e, 11) ^ rotr(e, 25)) + ((e & f) ^ (~e & g)) + sha256_k[i] + w[i];
+            uint32_t t2 = (rotr(a, 2) ^ rotr(a, 13) ^ rotr(a, 22)) + ((a & b) ^ (a & c) ^ (b & c));
+            hh = g; g = f; f = e; e = d + t1;
+            d = c; c = b; b = a; a = t1 + t2;
+        }
+        h[0] += a; h[1] += b; h[2] += c; h[3] += d;
+        h[4] += e; h[5] += f; h[6] += g; h[7] += hh;
+    }
+}
+
+#ifdef DIRSTATS_X86_DISPATCH
+// the state is kept as ABEF and CDGH, the order sha256rnds2 wants; each
+// group of 4 rounds also extends the message schedule 4 words ahead
+__attribute__((target("sha,sse4.1")))
+static void sha256_blocks_shani(uint32_t h[8], const unsigned char * p, size_t n) {
+    const __m128i bswap = _mm_set_epi64x(0x0c0d0e0f08090a0bULL, 0x0405060700010203ULL);
+    __m128i tmp = _mm_shuffle_epi32(_mm_loadu_si128((const __m128i *) &h[0]), 0xb1); //CDAB
+    __m128i state1 = _mm_shuffle_epi32(_mm_loadu_si128((const __m128i *) &h[4]), 0x1b); //EFGH
+    __m128i state0 = _mm_alignr_epi8(tmp, state1, 8); //ABEF
+    state1 = _mm_blend_epi16(state1, tmp, 0xf0); //CDGH
+    for (; n > 0; n--, p += 64) {
+        __m128i abef = state0, cdgh = state1;
+        __m128i m[4];
+        for (int g = 0; g < 16; g++) {
+            if (g < 4) m[g] = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i *) (p + 16 * g)), bswap);
+            __m128i msg = _mm_add_epi32(m[g % 4], _mm_loadu_si128((const __m128i *) &sha256_k[4 * g]));
+            state1 = _mm_sha256rnds2_epu32(state1, state0, msg);
+            if (g >= 3 && g <= 14) {
+                __m128i & next = m[(g + 1) % 4];
+                next = _mm_add_epi32(next, _mm_alignr_epi8(m[g % 4], m[(g + 3) % 4], 4));
+                next = _mm_sha256msg2_epu32(next, m[g % 4]);
+            }
+            state0 = _mm_sha256rnds2_epu32(state0, state1, _mm_shuffle_epi32(msg, 0x0e));
+            if (g >= 1 && g <= 12) m[(g + 3) % 4] = _mm_sha256msg1_epu32(m[(g + 3) % 4], m[g % 4]);
+        }
+        state0 = _mm_add_epi32(state0, abef);
+        state1 = _mm_add_epi32(state1, cdgh);
+    }
+    tmp = _mm_shuffle_epi32(state0, 0x1b); //FEBA
+    state1 = _mm_shuffle_epi32(state1, 0xb1); //DCHG
+    _mm_storeu_si128((__m128i *) &h[0], _mm_blend_epi16(tmp, state1, 0xf0)); //DCBA
+    _mm_storeu_si128((__m128i *) &h[4], _mm_alignr_epi8(state1, tmp, 8)); //HGFE
+}
+
+#define ROTR8(x, n) _mm256_or_si256(_mm256_srli_epi32(x, n), _mm256_slli_epi32(x, 32 - (n)))
+
+// r[i] = word i of each of the 8 rows
+__attribute__((target("avx2")))
+static void transpose8x8(__m256i r[8]) {
+    __m256i t[8], u[8];
+    for (int i = 0; i < 4; i++) {
+        t[2 * i] = _mm256_unpacklo_epi32(r[2 * i], r[2 * i + 1]);
+        t[2 * i + 1] = _mm256_unpackhi_epi32(r[2 * i], r[2 * i + 1]);
+    }
+    for (int i = 0; i < 2; i++) {
+        u[4 * i] = _mm256_unpacklo_epi64(t[4 * i], t[4 * i + 2]);
+        u[4 * i + 1] = _mm256_unpackhi_epi64(t[4 * i], t[4 * i + 2]);
+        u[4 * i + 2] = _mm256_unpacklo_epi64(t[4 * i + 1], t[4 * i + 3]);
+        u[4 * i + 3] = _mm256_unpackhi_epi64(t[4 * i + 1], t[4 * i + 3]);
+    }
+    for (int i = 0; i < 4; i++) {
+        r[i] = _mm256_permute2x128_si256(u[i], u[i + 4], 0x20);
+        r[i + 4] = _mm256_permute2x128_si256(u[i], u[i + 4], 0x31);
+    }
+}
+
+// compresses n blocks into each of 8 states at once
+//    st[i][l] = word i of the state of stream l
+//    p[l] = the n blocks of stream l
+__attribute__((target("avx2")))
+static void sha256_blocks_avx2x8(uint32_t st[8][8], const unsigned char * const p[8], size_t n) {
+    const __m256i bswap = _mm256_set_epi8(12, 13, 14, 15, 8, 9, 10, 11, 4, 5, 6, 7, 0, 1, 2, 3,
+                                          12, 13, 14, 15, 8, 9, 10, 11, 4, 5, 6, 7, 0, 1, 2, 3);
+    __m256i s[8];
+    for (int i = 0; i < 8; i++) s[i] = _mm256_loadu_si256((const __m256i *) st[i]);
+    for (size_t blk = 0; blk < n; blk++) {
+        __m256i w[16];
+        for (int half = 0; half < 2; half++) {
+            __m256i r[8];
+            for (int l = 0; l < 8; l++) r[l] = _mm256_loadu_si256((const __m256i *) (p[l] + 64 * blk + 32 * half));
+            transpose8x8(r);
+            for (int i = 0; i < 8; i++) w[8 * half + i] = _mm256_shuffle_epi8(r[i], bswap);
+        }
+        __m256i a = s[0], b = s[1], c = s[2], d = s[3], e = s[4], f = s[5], g = s[6], h = s[7];
+        for (int t = 0; t < 64; t++) {
+            if (t >= 16) {
+                __m256i w15 = w[(t - 15) & 15], w2 = w[(t - 2) & 15];
+                __m256i s0 = _mm256_xor_si256(_mm256_xor_si256(ROTR8(w15, 7), ROTR8(w15, 18)), _mm256_srli_epi32(w15, 3));
+                __m256i s1 = _mm256_xor_si256(_mm256_xor_si256(ROTR8(w2, 17), ROTR8(w2, 19)), _mm256_srli_epi32(w2, 10));
+                w[t & 15] = _mm256_add_epi32(_mm256_add_epi32(w[t & 15], s0), _mm256_add_epi32(w[(t - 7) & 15], s1));
+            }
+            __m256i s1 = _mm256_xor_si256(_mm256_xor_si256(ROTR8(e, 6), ROTR8(e, 11)), ROTR8(e, 25));
+            __m256i ch = _mm256_xor_si256(_mm256_and_si256(e, f), _mm256_andnot_si256(e, g));
+            __m256i t1 = _mm256_add_epi32(_mm256_add_epi32(h, s1), _mm256_add_epi32(ch, w[t & 15]));
+            t1 = _mm256_add_epi32(t1, _mm256_set1_epi32(sha256_k[t]));
+            __m256i s0 = _mm256_xor_si256(_mm256_xor_si256(ROTR8(a, 2), ROTR8(a, 13)), ROTR8(a, 22));
+            __m256i maj = _mm256_or_si256(_mm256_and_si256(a, b), _mm256_and_si256(c, _mm256_or_si256(a, b)));
+            h = g; g = f; f = e; e = _mm256_add_epi32(d, t1);
+            d = c; c = b; b = a; a = _mm256_add_epi32(t1, _mm256_add_epi32(s0, maj));
+        }
+        s[0] = _mm256_add_epi32(s[0], a); s[1] = _mm256_add_epi32(s[1], b);
+        s[2] = _mm256_add_epi32(s[2], c); s[3] = _mm256_add_epi32(s[3], d);
+        s[4] = _mm256_add_epi32(s[4], e); s[5] = _mm256_add_epi32(s[5], f);
+        s[6] = _mm256_add_epi32(s[6], g); s[7] = _mm256_add_epi32(s[7], h);
+    }
+    for (int i = 0; i < 8; i++) _mm256_storeu_si256((__m256i *) st[i], s[i]);
+}
+#undef ROTR8
+#endif
+
+// picks the kernels the CPU supports, once at startup: SHA-NI for single
+// streams if there is one, and whether to hash files 8 at a time with AVX2
+using Sha256Kernel = void (*)(uint32_t *, const unsigned char *, size_t);
+static Sha256Kernel
+pick_sha256_kernel() {
+#ifdef DIRSTATS_X86_DISPATCH
+    unsigned a, b, c, d;
+    //CPUID 7: bit 29 of ebx is SHA; CPUID 1: bit 19 of ecx is SSE4.1
+    if (__get_cpuid_count(7, 0, &a, &b, &c, &d) && (b >> 29 & 1)
+        && __get_cpuid(1, &a, &b, &c, &d) && (c >> 19 & 1))
+        return sha256_blocks_shani;
+#endif
+    return sha256_blocks_scalar;
+}
+static const Sha256Kernel sha256_kernel = pick_sha256_kernel();
+
+static bool
+use_sha256_x8() {
+#ifdef DIRSTATS_X86_DISPATCH
+    __builtin_cpu_init();
+    return sha256_kernel == sha256_blocks_scalar && __builtin_cpu_supports("avx2");
+#else
+    return false;
+#endif
+}
+static const bool sha256_x8 = use_sha256_x8();
+
+static std::string sha256_hex(const uint32_t h[8]) {
+    std::string res;
+    char hex[9];
+    for (int i = 0; i < 8; i++) {
+        snprintf(hex, sizeof(hex), "%08x", h[i]);
+        res += hex;
+    }
+    return res;
+}
+
+// appends the padding and length after the last len % 64 bytes of a message
+// of len bytes, which must be at b; returns the bytes in whole blocks
+static size_t sha256_pad(unsigned char * b, uint64_t len) {
+    size_t n = len % 64;
+    b[n++] = 0x80;
+    while (n % 64 != 56) b[n++] = 0;
+    for (int i = 0; i < 8; i++) b[n++] = (len * 8) >> (56 - 8 * i);
+    return n;
+}
+
+// one stream, incremental
+class Sha256 {
+    uint32_t h_[8];
+    uint64_t len_ = 0;
+    unsigned char buf_[128];
+    size_t buf_len_ = 0;
+
+    public:
+    Sha256() { memcpy(h_, sha256_init, sizeof(h_)); }
+    void update(const unsigned char * p, size_t n) {
+        len_ += n;
+        if (buf_len_) {
+            size_t k = std::min(n, 64 - buf_len_);
+            memcpy(buf_ + buf_len_, p, k);
+            buf_len_ += k; p += k; n -= k;
+            if (buf_len_ < 64) return;
+            sha256_kernel(h_, buf_, 1);
+            buf_len_ = 0;
+        }
+        sha256_kernel(h_, p, n / 64);
+        p += n / 64 * 64;
+        n %= 64;
+        memcpy(buf_, p, n);
+        buf_len_ = n;
+    }
+    std::string hex_digest() {
+        sha256_kernel(h_, buf_, sha256_pad(buf_, len_) / 64);
+        return sha256_hex(h_);
+    }
+};
+
+// 64-bit hash of a word, 8 bytes at a time
+static uint64_t hash_word(std::string_view w) {
+    uint64_t h = 0x9e3779b97f4a7c15ULL ^ w.size();
+    size_t i = 0;
+    for (; i + 8 <= w.size(); i += 8) {
+        uint64_t v;
+        memcpy(&v, w.data() + i, 8);
+        h = (h ^ v) * 0xff51afd7ed558ccdULL;
+        h ^= h >> 32;
+    }
+    uint64_t v = 0;
+    memcpy(&v, w.data() + i, w.size() - i);
+    h = (h ^ v) * 0xc4ceb9fe1a85ec53ULL;
+    return h ^ (h >> 29);
+}
+
+// word -> count histogram: open addressing with linear probing over a flat
+// array of slots, the words themselves are copied into a bump arena that is
+// only freed with the table, so counting a word already seen allocates
+// nothing and lookups need only a string_view
+class WordTable {
+    struct Slot {
+        const char * word = nullptr; // nullptr if the slot is empty
+        uint32_t len = 0;
+        uint32_t hash = 0;
+        int count = 0;
+    };
+    static constexpr size_t INITIAL_SLOTS = 256; // a power of 2
+    static constexpr size_t ARENA_BLOCK = 64 * 1024; // at least MAX_WORD_SIZE
+    std::vector<Slot> slots_ = std::vector<Slot>(INITIAL_SLOTS);
+    size_t size_ = 0;
+    std::vector<std::unique_ptr<char[]>> arena_;
+    char * arena_next_ = nullptr;
+    size_t arena_left_ = 0;
+
+    const char * store(std::string_view w) {
+        if (arena_left_ < w.size()) {
+            arena_.emplace_back(new char[ARENA_BLOCK]);
+            arena_next_ = arena_.back().get();
+            arena_left_ = ARENA_BLOCK;
+        }
+        char * p = arena_next_;
+        memcpy(p, w.data(), w.size());
+        arena_next_ += w.size();
+        arena_left_ -= w.size();
+        return p;
+    }
+    void grow() {
+        std::vector<Slot> old(slots_.size() * 2);
+        old.swap(slots_);
+        size_t mask = slots_.size() - 1;
+        for (auto & s : old) {
+            if (! s.word) continue;
+            size_t i = s.hash & mask;
+            while (slots_[i].word) i = (i + 1) & mask;
+            slots_[i] = s;
+        }
+    }
+
+    public:
+    // returns the table's copy of the word, which stays where it is as long
+    // as the table is neither cleared nor destroyed
+    const char * add(std::string_view w, int count = 1) {
+        uint32_t h = hash_word(w);
+        size_t mask = slots_.size() - 1;
+        for (size_t i = h & mask; ; i = (i + 1) & mask) {
+            Slot & s = slots_[i];
+            if (! s.word) break;
+            if (s.hash == h && s.len == w.size() && memcmp(s.word, w.data(), w.size()) == 0) {
+                s.count += count;
+                return s.word;
+            }
+        }
+        //not there yet, keep the table at most half full
+        if (2 * (size_ + 1) > slots_.size()) {
+            grow();
+            mask = slots_.size() - 1;
+        }
+        size_t i = h & mask;
+        while (slots_[i].word) i = (i + 1) & mask;
+        slots_[i] = { store(w), uint32_t(w.size()), h, count };
+        size_++;
+        return slots_[i].word;
+    }
+    void add(const WordTable & o) {
+        o.for_each([&](std::string_view w, int count) { add(w, count); });
+    }
+    // calls f(word, count) for every word, in no particular order
+    template <class F> void for_each(F f) const {
+        for (auto & s : slots_)
+            if (s.word) f(std::string_view(s.word, s.len), s.count);
+    }
+    size_t size() const { return size_; }
+    // empties the table, a table that grew big for one file shrinks back
+    void clear() {
+        if (slots_.size() > INITIAL_SLOTS * 64) slots_ = std::vector<Slot>(INITIAL_SLOTS);
+        else std::fill(slots_.begin(), slots_.end(), Slot());
+        size_ = 0;
+        if (arena_.size() > 1) arena_.resize(1);
+        arena_next_ = arena_.empty() ? nullptr : arena_[0].get();
+        arena_left_ = arena_.empty() ? 0 : ARENA_BLOCK;
+    }
+};
+
+// lower case of every letter [a-zA-Z], 0 for everything else
+static const struct LetterTable {
+    unsigned char lower[256] = {};
+    LetterTable() {
+        for (int c = 'a'; c <= 'z'; c++) lower[c] = lower[c - 'a' + 'A'] = c;
+    }
+} letters;
+
+//CODE SNIPPET MODIFIED FROM https://gitlab.com/cpsc457/public/word-histogram
+// counts the words in a stream of blocks
+//     - word is a sequence of characters [a-zA-Z]
+//     - the word is converted into lower case
+//     - words are separated by any non alphabetic characters
+//     - only words of 3 or more characters are counted
+// a word can continue from one block into the next; blocks are scanned a
+// run of letters (or separators) at a time
+struct WordCounter {
+    char word[MAX_WORD_SIZE];
+    size_t len = 0;
+    void feed(const unsigned char * b, size_t n, WordTable & hist) {
+        for (size_t i = 0; i < n; ) {
+            if (len == 0) //skips the separators
+                while (i < n && ! letters.lower[b[i]]) i++;
+            size_t start = i;
+            while (i < n && letters.lower[b[i]]) i++;
+            if(len + (i - start) > MAX_WORD_SIZE) {
+                printf("input exceeded %d word size, aborting...\n", MAX_WORD_SIZE);
+                exit(-1);
+            }
+            for (size_t k = start; k < i; k++) word[len++] = letters.lower[b[k]];
+            if (i < n) finish(hist); //the run of letters ended in this block
+        }
+    }
+    // ends the current word, also call at EOF
+    void finish(WordTable & hist) {
+        if(len >= 3) //if word is 3 chars or greater (requirement), adds it to the histogram
+            hist.add(std::string_view(word, len));
+        len = 0;
+    }
+};
+
+// -----------------------------------------------------------------------------
+// approximate counting in bounded memory
+//
+// Space-Saving (Metwally et al.) monitors at most k items; an item that is
+// not monitored takes over the counter with the smallest count and inherits
+// a possible over-count: no more than the largest count ever evicted (what
+// any item that is not monitored can have had), and no more than what a
+// Count-Min sketch updated alongside says the newcomer could have had. So
+// every counter is an upper bound of the item's true count and is too high
+// by at most its error, and an item that is not monitored occurred at most
+// unmonitored_max() times
+class TopKSketch {
+    struct Counter {
+        std::string item;
+        long count, error;
+    };
+    static constexpr int DEPTH = 4; // rows of the Count-Min sketch
+    size_t k_;
+    std::vector<Counter> counters_; // never move, where_ points into them
+    std::vector<uint32_t> heap_, pos_; // min-heap of counters_ on count, and where each one is in it
+    std::unordered_map<std::string_view,uint32_t> where_;
+    size_t width_;
+    std::vector<uint64_t> cm_;
+    long evicted_max_ = 0;
+
+    size_t cell(int d, uint64_t h) const { return d * width_ + ((h + d * (h >> 32 | 1)) & (width_ - 1)); }
+    long estimate(std::string_view item) const {
+        uint64_t h = hash_word(item), est = UINT64_MAX;
+        for (int d = 0; d < DEPTH; d++) est = std::min(est, cm_[cell(d, h)]);
+        return est;
+    }
+    long count(uint32_t heap_pos) const { return counters_[heap_[heap_pos]].count; }
+    void swap_heap(size_t a, size_t b) {
+        std::swap(heap_[a], heap_[b]);
+        pos_[heap_[a]] = a;
+        pos_[heap_[b]] = b;
+    }
+    void sift_down(size_t i) {
+        while (1) {
+            size_t m = i, l = 2 * i + 1, r = l + 1;
+            if (l < heap_.size() && count(l) < count(m)) m = l;
+            if (r < heap_.size() && count(r) < count(m)) m = r;
+            if (m == i) return;
+            swap_heap(i, m);
+            i = m;
+        }
+    }
+    void sift_up(size_t i) {
+        for (; i > 0 && count(i) < count((i - 1) / 2); i = (i - 1) / 2) swap_heap(i, (i - 1) / 2);
+    }
+    // rebuilds the heap and the index from counters_
+    void reindex() {
+        where_.clear();
+        heap_.resize(counters_.size());
+        pos_.resize(counters_.size());
+        for (uint32_t i = 0; i < counters_.size(); i++) {
+            where_.emplace(counters_[i].item, i);
+            heap_[i] = pos_[i] = i;
+        }
+        for (size_t i = heap_.size() / 2; i-- > 0; ) sift_down(i);
+    }
+
+    public:
+    // k counters, and a Count-Min sketch 4 rows of at least 4k cells wide
+    explicit TopKSketch(size_t k) : k_(std::max<size_t>(k, 1)), width_(1024) {
+        while (width_ < 4 * k_) width_ *= 2;
+        counters_.reserve(k_);
+        where_.reserve(k_);
+        cm_.assign(DEPTH * width_, 0);
+    }
+    TopKSketch(const TopKSketch &) = delete;
+    TopKSketch & operator=(const TopKSketch &) = delete;
+
+    void add(std::string_view item, long c = 1) {
+        uint64_t h = hash_word(item), est = UINT64_MAX;
+        for (int d = 0; d < DEPTH; d++) est = std::min(est, cm_[cell(d, h)] += c);
+        auto it = where_.find(item);
+        if (it != where_.end()) {
+            counters_[it->second].count += c;
+            sift_down(pos_[it->second]);
+            return;
+        }
+        if (counters_.size() < k_) {
+            uint32_t i = counters_.size();
+            counters_.push_back({ std::string(item), c, 0 });
+            where_.emplace(counters_[i].item, i);
+            heap_.push_back(i);
+            pos_.push_back(heap_.size() - 1);
+            sift_up(heap_.size() - 1);
+            return;
+        }
+        //replaces the smallest counter
+        Counter & m = counters_[heap_[0]];
+        evicted_max_ = std::max(evicted_max_, m.count);
+        long inherited = std::min<long>(evicted_max_, est - c);
+        where_.erase(m.item);
+        m.item.assign(item.data(), item.size());
+        m.count = inherited + c;
+        m.error = inherited;
+        where_.emplace(m.item, heap_[0]);
+        sift_down(0);
+    }
+    // upper bound for the count of any item that is not monitored
+    long unmonitored_max() const { return evicted_max_; }
+    size_t capacity() const { return k_; }
+    // adds another sketch (of the same k) into this one, as if this one had
+    // seen everything the other one did
+    void merge(const TopKSketch & o) {
+        for (size_t i = 0; i < cm_.size(); i++) cm_[i] += o.cm_[i];
+        long my_min = evicted_max_, o_min = o.evicted_max_;
+        std::vector<Counter> all;
+        for (auto & c : counters_) {
+            auto it = o.where_.find(c.item);
+            if (it == o.where_.end()) all.push_back({ c.item, c.count + o_min, c.error + o_min });
+            else all.push_back({ c.item, c.count + o.counters_[it->second].count, c.error + o.counters_[it->second].error });
+        }
+        for (auto & c : o.counters_)
+            if (! where_.count(c.item)) all.push_back({ c.item, c.count + my_min, c.error + my_min });
+        //the merged Count-Min may know better
+        for (auto & c : all) {
+            long est = estimate(c.item);
+            if (c.count > est) {
+                c.error -= c.count - est;
+                c.count = est;
+            }
+        }
+        evicted_max_ = my_min + o_min;
+        if (all.size() > k_) {
+            std::nth_element(all.begin(), all.begin() + k_, all.end(),
+                             [](const Counter & a, const Counter & b) { return a.count > b.count; });
+            for (size_t i = k_; i < all.size(); i++) evicted_max_ = std::max(evicted_max_, all[i].count);
+            all.resize(k_);
+        }
+        where_.clear();
+        counters_ = std::move(all);
+        reindex();
+    }
+    // the n items with the highest counts as (item, count, error), sorted
+    // like the exact results: by count, then by item
+    std::vector<std::tuple<std::string,long,long>> top(size_t n) const {
+        std::vector<const Counter *> v;
+        for (auto & c : counters_) v.push_back(&c);
+        auto cmp = [](const Counter * a, const Counter * b) {
+            return a->count != b->count ? a->count > b->count : a->item < b->item;
+        };
+        n = std::min(n, v.size());
+        std::partial_sort(v.begin(), v.begin() + n, v.end(), cmp);
+        std::vector<std::tuple<std::string,long,long>> res;
+        for (size_t i = 0; i < n; i++) res.emplace_back(v[i]->item, v[i]->count, v[i]->error);
+        return res;
+    }
+};
+
+static bool is_dir(const std::string & path)
+{
+    struct stat buff;
+    if (0 != stat(path.c_str(), &buff)) return false;
+    return S_ISDIR(buff.st_mode);
+}
+
+
+// -----------------------------------------------------------------------------
+// parallel traversal
+//
+// the tree is walked by a pool of workers, each with its own deque of
+// paths to visit and its own histograms, which get merged at the end
+//
+// entries are opened relative to their parent directory (openat() and
+// fstatat() on a fd the parent's tasks share), so the kernel never walks
+// the full path again; the full path is only kept for the output
+//
+// to get exactly the same Results as the old single-stack walk, every path
+// knows its position in that walk: the old walk pushed the entries of a
+// directory in readdir() order and popped them from the back, so the i-th
+// of k entries was visited (k-1-i)-th; each PathNode keeps this rank, and
+// visited_before() compares two paths by their ranks below the directory
+// they have in common
+
+// an open directory, shared by the tasks of its entries and closed when the
+// last of them is done
+struct DirFd {
+    int fd;
+    static inline std::atomic<int> n_open{0};
+    explicit DirFd(int fd) : fd(fd) { n_open++; }
+    ~DirFd() { close(fd); n_open--; }
+    DirFd(const DirFd &) = delete;
+    DirFd & operator=(const DirFd &) = delete;
+};
+
+// how many directories may be kept open, leaves half of the fd limit for
+// the files being read and everything else
+static int dir_fd_limit() {
+    static const int limit = [] {
+        struct rlimit rl;
+        if (getrlimit(RLIMIT_NOFILE, &rl) != 0 || rl.rlim_cur == RLIM_INFINITY) return 512;
+        return int(std::min<rlim_t>(rl.rlim_cur / 2, 1 << 20));
+    }();
+    return limit;
+}
+
+// a directory on the way down from the root, so that a followed symlink
+// that leads back up to one of them can be told apart from a real subtree
+struct DirId {
+    dev_t dev;
+    ino_t ino;
+    std::shared_ptr<const DirId> up;
+};
+
+// true if st is one of the directories from d up to the root
+static bool on_path(const DirId * d, const struct stat & st) {
+    for (; d; d = d->up.get())
+        if (d->dev == st.st_dev && d->ino == st.st_ino) return true;
+    return false;
+}
+
+// a path, stored as the directory it is in and its own name, so that the
+// prefix the entries of a directory share is stored once, in its node
+struct PathNode {
+    const PathNode * dir; // nullptr for the root, whose name is the path it was given
+    const char * name; // NUL-terminated
+    uint32_t rank; // among the entries of dir, in the old walk's order
+};
+
+// the PathNodes a worker creates, in blocks that never move, so the nodes
+// stay valid (and readable by every worker) until the arena is destroyed
+class PathArena {
+    static constexpr size_t BLOCK = 64 * 1024; // more than a node and PATH_MAX
+    std::vector<std::unique_ptr<char[]>> blocks_;
+    char * next_ = nullptr;
+    size_t left_ = 0;
+
+    public:
+    // the rank is set by the caller before the node is handed to other workers
+    PathNode * add(const PathNode * dir, std::string_view name) {
+        size_t pad = -uintptr_t(next_) % alignof(PathNode);
+        size_t need = pad + sizeof(PathNode) + name.size() + 1;
+        if (left_ < need) {
+            blocks_.emplace_back(new char[BLOCK]); //aligned for any type
+            next_ = blocks_.back().get();
+            left_ = BLOCK;
+            pad = 0;
+            need = sizeof(PathNode) + name.size() + 1;
+        }
+        auto node = (PathNode *) (next_ + pad);
+        char * str = (char *) (node + 1);
+        memcpy(str, name.data(), name.size());
+        str[name.size()] = 0;
+        *node = { dir, str, 0 };
+        next_ += need;
+        left_ -= need;
+        return node;
+    }
+};
+
+// the full path of a node, its names from the root down joined by '/'
+static std::string full_path(const PathNode * p) {
+    std::vector<const char *> names;
+    for (; p; p = p->dir) names.push_back(p->name);
+    std::string path;
+    for (size_t i = names.size(); i-- > 0; ) {
+        path += names[i];
+        if (i) path += '/';
+    }
+    return path;
+}
+
+// true if the old walk would have visited a before b: the ranks of the
+// two paths are compared just below the deepest directory they share
+static bool visited_before(const PathNode * a, const PathNode * b) {
+    int da = 0, db = 0;
+    for (auto p = a; p->dir; p = p->dir) da++;
+    for (auto p = b; p->dir; p = p->dir) db++;
+    bool shallower = da < db; // if one is above the other, it came first
+    for (; da > db; da--) a = a->dir;
+    for (; db > da; db--) b = b->dir;
+    if (a == b) return shallower;
+    while (a->dir != b->dir) {
+        a = a->dir;
+        b = b->dir;
+    }
+    return a->rank < b->rank;
+}
+
+struct Task {
+    const PathNode * path = nullptr;
+    unsigned char d_type = DT_UNKNOWN; // from the parent's getdents64()
+    std::shared_ptr<DirFd> parent = nullptr; // nullptr: open by the full path (e.g. the root)
+    std::shared_ptr<const DirId> dirs = nullptr; // the directories above, only when following symlinks
+    std::string full; // the full path, only kept when there is no parent
+
+    int at_fd() const { return parent ? parent->fd : AT_FDCWD; }
+    const char * name() const { return parent ? path->name : full.c_str(); }
+};
+
+// (device, inode, size, mtime in ns), a file with the same key is assumed
+// to have the same contents as when it was cached
+struct CacheKey {
+    uint64_t dev, ino;
+    int64_t size, mtime_ns;
+    bool operator<(const CacheKey & o) const {
+        return std::tie(dev, ino, size, mtime_ns) < std::tie(o.dev, o.ino, o.size, o.mtime_ns);
+    }
+    bool operator==(const CacheKey & o) const {
+        return dev == o.dev && ino == o.ino && size == o.size && mtime_ns == o.mtime_ns;
+    }
+};
+
+struct CacheRecord;
+
+// a regular file that could be read, these are the candidates for duplicates
+struct FileRecord {
+    long size;
+    uint64_t partial; // hash of the size and the first and last EDGE_SIZE bytes
+    const PathNode * path;
+    std::string hash; // SHA-256, only computed if size and partial collide
+    CacheKey key {}; // the same for every path to the same inode
+
+    // only set when there is a scan cache and the file is not a symlink
+    bool cacheable = false;
+    const CacheRecord * cached = nullptr; // type and words are in the old cache
+    std::string type;
+    std::vector<std::pair<std::string,int>> words;
+};
+
+// where the time goes: nanoseconds per phase (summed over the workers) and
+// how often the kernel was asked for what; an operation done through
+// io_uring counts as the syscall it replaces, and waiting for the ring is
+// read while any file read is in flight, io_wait while only opens and
+// stats are
+enum Phase { TRAVERSE, OPEN_STAT, READ, TOKENIZE, FILE_TYPE, IO_WAIT, FULL_HASH, CACHE_WRITE, REPORT, N_PHASES };
+static const char * const phase_names[N_PHASES] = {
+    "traverse", "open_stat", "read", "tokenize", "file_type", "io_wait", "full_hash", "cache_write", "report"
+};
+enum Call { OPEN, STAT, READ_CALL, GETDENTS, CLOSE, URING_ENTER, N_CALLS };
+static const char * const call_names[N_CALLS] = { "open", "stat", "read", "getdents", "close", "io_uring_enter" };
+
+// the Metrics fields the phases and calls are reported in
+static long Metrics::* const phase_fields[N_PHASES] = {
+    &Metrics::traverse_ns, &Metrics::open_stat_ns, &Metrics::read_ns, &Metrics::tokenize_ns, &Metrics::file_type_ns,
+    &Metrics::io_wait_ns, &Metrics::full_hash_ns, &Metrics::cache_write_ns, &Metrics::report_ns
+};
+static long Metrics::* const call_fields[N_CALLS] = {
+    &Metrics::open_calls, &Metrics::stat_calls, &Metrics::read_calls, &Metrics::getdents_calls,
+    &Metrics::close_calls, &Metrics::io_uring_enter_calls
+};
+
+// what a worker (or all of them) counted so far
+struct Counters {
+    long ns[N_PHASES] = {};
+    long calls[N_CALLS] = {};
+    long bytes_read = 0, cache_hits = 0, hashed_files = 0;
+
+    void add(const Counters & o) {
+        for (int i = 0; i < N_PHASES; i++) ns[i] += o.ns[i];
+        for (int i = 0; i < N_CALLS; i++) calls[i] += o.calls[i];
+        bytes_read += o.bytes_read;
+        cache_hits += o.cache_hits;
+        hashed_files += o.hashed_files;
+    }
+};
+
+static long now_ns() {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+// adds the time from its construction to its destruction to a phase
+struct PhaseTimer {
+    long & ns;
+    long start = now_ns();
+    ~PhaseTimer() { ns += now_ns() - start; }
+};
+
+// everything one worker collects
+struct Stats {
+    WordTable words_hist;
+    std::unordered_map<std::string,int> types_hist;
+    //with approximate counting these are used instead of the histograms
+    std::unique_ptr<TopKSketch> words_sketch, types_sketch;
+    std::vector<FileRecord> files;
+    long n_files = 0, n_dirs = 0, all_files_size = 0;
+    long largest_file_size = -1;
+    const PathNode * largest_file = nullptr;
+    Counters m;
+    PathArena paths; // of the entries of the directories this worker read
+};
+
+// one deque per worker: the owner takes from the back (depth first, like
+// the old stack), idle workers steal from the front, where the biggest
+// unexplored subtrees are
+class WorkQueues {
+    struct alignas(64) Queue {
+        std::mutex m;
+        std::deque<Task> tasks;
+    };
+    std::vector<Queue> queues_;
+    std::atomic<long> pending_{0}; // pushed but not finished yet
+    std::atomic<long> queued_{0}; // in the deques, roughly
+    // workers with nothing to do sleep here until a push or the end
+    std::mutex idle_m_;
+    std::condition_variable idle_cv_;
+    std::atomic<int> idle_{0};
+
+    void wake(bool all) {
+        { std::lock_guard<std::mutex> lk(idle_m_); } // a waiter is either asleep or sees the change
+        if (all) idle_cv_.notify_all();
+        else idle_cv_.notify_one();
+    }
+
+    public:
+    WorkQueues(int n) : queues_(n) {}
+    void push(int w, Task && t) {
+        pending_++;
+        {
+            std::lock_guard<std::mutex> lk(queues_[w].m);
+            queues_[w].tasks.push_back(std::move(t));
+        }
+        queued_++;
+        if (idle_) wake(false);
+    }
+    // own tasks first, then try to steal from everyone else
+    bool pop(int w, Task & t) {
+        int n = queues_.size();
+        for (int i = 0; i < n; i++) {
+            Queue & q = queues_[(w + i) % n];
+            std::lock_guard<std::mutex> lk(q.m);
+            if (q.tasks.empty()) continue;
+            if (i == 0) {
+                t = std::move(q.tasks.back());
+                q.tasks.pop_back();
+            } else {
+                t = std::move(q.tasks.front());
+                q.tasks.pop_front();
+            }
+            queued_--;
+            return true;
+        }
+        return false;
+    }
+    void done() {
+        if (--pending_ == 0) wake(true);
+    }
+    // sleeps until there may be a task to pop, false once everything is
+    // finished: nothing queued and nobody working on something that could
+    // add more
+    bool wait() {
+        std::unique_lock<std::mutex> lk(idle_m_);
+        idle_++;
+        idle_cv_.wait(lk, [this] { return queued_ > 0 || pending_ == 0; });
+        idle_--;
+        return pending_ != 0;
+    }
+};
+
+// number of worker threads, DIRSTATS_THREADS overrides the default of one
+// per core
+static int worker_count() {
+    const char * s = getenv("DIRSTATS_THREADS");
+    int n = s ? atoi(s) : 0;
+    if (n <= 0) n = std::thread::hardware_concurrency();
+    return std::max(n, 1);
+}
+
+// -----------------------------------------------------------------------------
+// scan cache
+//
+// if DIRSTATS_CACHE names a file, it remembers for every regular file that
+// was read its words, type, partial hash and (if duplicate detection needed
+// it) SHA-256, keyed by CacheKey, and the next scan only reads the files
+// whose key is not in it
+//
+// the file is mmap()ed and searched in place, nothing is parsed up front;
+// it is in native byte order and laid out as
+//    CacheHeader | CacheRecord[n_records], sorted by key
+//                | CacheWord[n_words] | strings (u32 length + bytes)
+// and rewritten after every scan, into a temporary file renamed over it
+constexpr char CACHE_MAGIC[8] = { 'G', 'D', 'S', 'C', 'A', 'C', 'H', '1' };
+
+struct CacheHeader {
+    char magic[8];
+    uint64_t n_records, n_words, strings_size;
+};
+
+struct CacheRecord {
+    CacheKey key;
+    uint64_t partial;
+    unsigned char sha[32];
+    uint32_t has_sha;
+    uint32_t type; // offset in the strings
+    uint64_t words, n_words; // range in the CacheWords
+};
+
+struct CacheWord {
+    uint32_t str; // offset in the strings
+    uint32_t count;
+};
+
+static CacheKey cache_key(const struct stat & st) {
+    return { uint64_t(st.st_dev), uint64_t(st.st_ino), int64_t(st.st_size),
+             int64_t(st.st_mtim.tv_sec) * 1000000000 + st.st_mtim.tv_nsec };
+}
+
+static std::string sha_to_hex(const unsigned char * sha) {
+    static const char digits[] = "0123456789abcdef";
+    std::string res;
+    for (int i = 0; i < 32; i++) {
+        res += digits[sha[i] >> 4];
+        res += digits[sha[i] & 15];
+    }
+    return res;
+}
+
+static void hex_to_sha(const std::string & hex, unsigned char * sha) {
+    auto nibble = [](char c) { return c <= '9' ? c - '0' : c - 'a' + 10; };
+    for (int i = 0; i < 32; i++)
+        sha[i] = nibble(hex[2 * i]) << 4 | nibble(hex[2 * i + 1]);
+}
+
+// read-only view of a cache file, empty if there is none or it is not valid
+class ScanCache {
+    void * map_ = MAP_FAILED;
+    size_t size_ = 0;
+    const CacheRecord * records_ = nullptr;
+    const CacheWord * words_ = nullptr;
+    const unsigned char * strings_ = nullptr;
+    uint64_t n_records_ = 0, n_words_ = 0, strings_size_ = 0;
+
+    public:
+    explicit ScanCache(const std::string & path) {
+        int fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+        if (fd < 0) return;
+        struct stat st;
+        if (fstat(fd, &st) == 0 && size_t(st.st_size) >= sizeof(CacheHeader)) {
+            size_ = st.st_size;
+            map_ = mmap(nullptr, size_, PROT_READ, MAP_PRIVATE, fd, 0);
+        }
+        close(fd);
+        if (map_ == MAP_FAILED) return;
+        auto base = (const unsigned char *) map_;
+        auto hdr = (const CacheHeader *) base;
+        size_t rest = size_ - sizeof(CacheHeader);
+        if (memcmp(hdr->magic, CACHE_MAGIC, sizeof(CACHE_MAGIC)) != 0
+            || hdr->n_records > rest / sizeof(CacheRecord)
+            || hdr->n_words > (rest - hdr->n_records * sizeof(CacheRecord)) / sizeof(CacheWord)
+            || hdr->strings_size != rest - hdr->n_records * sizeof(CacheRecord) - hdr->n_words * sizeof(CacheWord))
+            return;
+        n_records_ = hdr->n_records;
+        n_words_ = hdr->n_words;
+        strings_size_ = hdr->strings_size;
+        records_ = (const CacheRecord *) (base + sizeof(CacheHeader));
+        words_ = (const CacheWord *) (records_ + n_records_);
+        strings_ = (const unsigned char *) (words_ + n_words_);
+    }
+    ~ScanCache() { if (map_ != MAP_FAILED) munmap(map_, size_); }
+    ScanCache(const ScanCache &) = delete;
+    ScanCache & operator=(const ScanCache &) = delete;
+
+    // the record of a file, nullptr if it is not cached
+    const CacheRecord * find(const CacheKey & key) const {
+        auto end = records_ + n_records_;
+        auto it = std::lower_bound(records_, end, key,
+                                   [](const CacheRecord & r, const CacheKey & k) { return r.key < k; });
+        if (it == end || ! (it->key == key)) return nullptr;
+        if (it->words > n_words_ || it->n_words > n_words_ - it->words) return nullptr;
+        return it;
+    }
+    const CacheWord * words(const CacheRecord & r) const { return words_ + r.words; }
+    std::string_view str(uint32_t off) const {
+        uint32_t len;
+        if (off > strings_size_ || strings_size_ - off < sizeof(len)) return {};
+        memcpy(&len, strings_ + off, sizeof(len));
+        if (len > strings_size_ - off - sizeof(len)) return {};
+        return { (const char *) strings_ + off + sizeof(len), len };
+    }
+};
+
+// writes the cache for the next scan, from the files of this one
+// (cached files still point into old, so it must be open until this returns)
+static bool write_scan_cache(const std::string & path, std::vector<const FileRecord *> files,
+                             const ScanCache & old) {
+    std::sort(files.begin(), files.end(), [](const FileRecord * a, const FileRecord * b) { return a->key < b->key; });
+    //hard links show up once per name, the cache needs them once
+    files.erase(std::unique(files.begin(), files.end(),
+                            [](const FileRecord * a, const FileRecord * b) { return a->key == b->key; }),
+                files.end());
+
+    std::vector<CacheRecord> records;
+    std::vector<CacheWord> words;
+    std::string strings;
+    std::unordered_map<std::string,uint32_t> string_offs; //every string is stored once
+    auto intern = [&](std::string_view s) {
+        auto it = string_offs.emplace(std::string(s), strings.size());
+        if (it.second) {
+            uint32_t len = s.size();
+            strings.append((const char *) &len, sizeof(len));
+            strings.append(s.data(), s.size());
+        }
+        return it.first->second;
+    };
+    for (auto f : files) {
+        CacheRecord r {};
+        r.key = f->key;
+        r.partial = f->partial;
+        r.has_sha = ! f->hash.empty();
+        if (r.has_sha) hex_to_sha(f->hash, r.sha);
+        r.words = words.size();
+        if (f->cached) {
+            r.type = intern(old.str(f->cached->type));
+            const CacheWord * w = old.words(*f->cached);
+            for (uint64_t i = 0; i < f->cached->n_words; i++)
+                words.push_back({ intern(old.str(w[i].str)), w[i].count });
+        }
+        else {
+            r.type = intern(f->type);
+            for (auto & w : f->words)
+                words.push_back({ intern(w.first), uint32_t(w.second) });
+        }
+        r.n_words = words.size() - r.words;
+        records.push_back(r);
+        if (strings.size() > UINT32_MAX) return false; //offsets would not fit
+    }
+
+    CacheHeader hdr;
+    memcpy(hdr.magic, CACHE_MAGIC, sizeof(CACHE_MAGIC));
+    hdr.n_records = records.size();
+    hdr.n_words = words.size();
+    hdr.strings_size = strings.size();
+    std::string tmp = path + ".tmp." + std::to_string(getpid());
+    FILE * out = fopen(tmp.c_str(), "wb");
+    if (! out) return false;
+    bool ok = fwrite(&hdr, sizeof(hdr), 1, out) == 1
+        && fwrite(records.data(), sizeof(CacheRecord), records.size(), out) == records.size()
+        && fwrite(words.data(), sizeof(CacheWord), words.size(), out) == words.size()
+        && fwrite(strings.data(), 1, strings.size(), out) == strings.size();
+    ok = fclose(out) == 0 && ok;
+    if (ok) ok = rename(tmp.c_str(), path.c_str()) == 0;
+    if (! ok) unlink(tmp.c_str());
+    return ok;
+}
+
+// -----------------------------------------------------------------------------
+// visiting files and directories
+
+constexpr size_t READ_SIZE = 256 * 1024; // bytes per read() of a file
+constexpr size_t EDGE_SIZE = 4096; // bytes at each end of a file in its partial hash
+
+// 64-bit FNV-1a, good enough to tell apart files of the same size
+static uint64_t fnv1a(const unsigned char * p, size_t n, uint64_t h = 0xcbf29ce484222325ULL) {
+    for (size_t i = 0; i < n; i++) {
+        h ^= p[i];
+        h *= 0x100000001b3ULL;
+    }
+    return h;
+}
+
+// keeps the last EDGE_SIZE bytes of everything passed in
+static void keep_tail(std::vector<unsigned char> & tail, const unsigned char * p, size_t n) {
+    if (n >= EDGE_SIZE) {
+        tail.assign(p + n - EDGE_SIZE, p + n);
+        return;
+    }
+    tail.insert(tail.end(), p, p + n);
+    if (tail.size() > EDGE_SIZE) tail.erase(tail.begin(), tail.end() - EDGE_SIZE);
+}
+
+// one file on its way through the scan, kept apart so that the reads of
+// several files can be in flight at once (see the io_uring backend):
+// start_file() once it is open and stat()ed, feed_file() with every block
+// read, in order, then finish_file()
+struct FileScan {
+    Task t;
+    int fd = -1; //the file opened for reading, or -1 if that failed
+    struct stat st; //its fstat(), or stat() if it could not be opened
+    bool stat_ok = false; //false if even stat() failed (e.g. a broken symlink)
+
+    bool is_link = false, readable = false, cacheable = false;
+    bool shared = false; //the inode may have other paths, its words go through the InodeSet
+    bool first_path = true; //false if another path to the inode reads it
+    const CacheRecord * hit = nullptr; //the file's scan cache record
+    bool per_file = false; //words go to words before the worker's histogram
+    WordCounter counter;
+    std::vector<unsigned char> head, tail; //start and end of the file
+    WordTable words; //words of the file, for the cache or the sketch
+};
+
+// what a worker reuses from one file to the next
+struct Scratch {
+    std::vector<unsigned char> buf = std::vector<unsigned char>(READ_SIZE); //blocks read from files
+    FileScan file; //the file being visited synchronously
+};
+
+// the inodes of the regular files seen so far, to read a file that can be
+// reached by several paths (hard links, followed symlinks) only once but
+// count its words for every path: the first path reads them and counts
+// them for all the paths that claimed the inode by then, and leaves them
+// with the inode for those still to come; sharded by inode so that the
+// workers seldom wait for each other
+class InodeSet {
+    // a word of an inode, the text is kept by the histogram of the worker
+    // that read it
+    struct WordRef {
+        const char * word;
+        uint32_t len;
+        int count;
+    };
+    struct Inode {
+        int paths = 1;
+        std::vector<WordRef> words; // empty until the first path is read
+    };
+    struct alignas(64) Shard {
+        std::mutex m;
+        std::map<std::pair<dev_t,ino_t>,Inode> seen;
+    };
+    static constexpr int N_SHARDS = 16;
+    Shard shards_[N_SHARDS];
+
+    Shard & shard(const struct stat & st) { return shards_[st.st_ino % N_SHARDS]; }
+
+    public:
+    // true for the first path to the inode of st, which then has to
+    // settle() it; a later path gets the words of the inode added to hist
+    // if they are known already
+    bool claim(const struct stat & st, WordTable & hist) {
+        Shard & s = shard(st);
+        std::lock_guard<std::mutex> lk(s.m);
+        auto r = s.seen.try_emplace({ st.st_dev, st.st_ino });
+        if (r.second) return true;
+        Inode & in = r.first->second;
+        in.paths++;
+        for (auto & w : in.words) hist.add(std::string_view(w.word, w.len), w.count);
+        return false;
+    }
+    // the first path has read the words of the inode: adds them to its
+    // hist once for every path so far, and keeps them for later paths
+    void settle(const struct stat & st, const WordTable & words, WordTable & hist) {
+        Shard & s = shard(st);
+        std::lock_guard<std::mutex> lk(s.m);
+        Inode & in = s.seen[{ st.st_dev, st.st_ino }];
+        in.words.reserve(words.size());
+        words.for_each([&](std::string_view w, int count) {
+            in.words.push_back({ hist.add(w, count * in.paths), uint32_t(w.size()), count });
+        });
+    }
+};
+
+// symlinks are followed (with loops cut off) unless DIRSTATS_SYMLINKS is
+// nofollow, then each is reported as a file of its own, like file -h does;
+// the root directory is always followed
+static bool follow_symlinks() {
+    const char * s = getenv("DIRSTATS_SYMLINKS");
+    return ! (s && strcmp(s, "nofollow") == 0);
+}
+
+// what the workers share while walking the tree
+struct Walk {
+    WorkQueues & queues;
+    const ScanCache * cache; //nullptr if there is none
+    bool follow_links;
+    InodeSet * inodes; //nullptr if the caller keeps track of inodes itself
+};
+
+// reads just the first SNIFF_SIZE and the last EDGE_SIZE bytes of a file,
+// all that the type detection and the partial hash need
+static void read_edges(FileScan & f, Stats & stats) {
+    PhaseTimer timer { stats.m.ns[READ] };
+    auto read_at = [&](std::vector<unsigned char> & v, size_t n, off_t off) {
+        v.resize(n);
+        size_t got = 0;
+        while (got < n) {
+            stats.m.calls[READ_CALL]++;
+            ssize_t len = pread(f.fd, v.data() + got, n - got, off + got);
+            if (len < 0 && errno == EINTR) continue;
+            if (len <= 0) break;
+            got += len;
+        }
+        v.resize(got);
+        stats.m.bytes_read += got;
+    };
+    size_t size = f.st.st_size;
+    read_at(f.head, std::min(size, SNIFF_SIZE), 0);
+    if (size <= SNIFF_SIZE) keep_tail(f.tail, f.head.data(), f.head.size());
+    else read_at(f.tail, EDGE_SIZE, size - EDGE_SIZE);
+}
+
+// decides what to do with a file that has been opened and stat()ed: only
+// regular files have contents worth reading, and not those found in the
+// scan cache or reached by an earlier path already (of those only the
+// edges are read here); returns whether it needs to be read
+static bool start_file(FileScan & f, Stats & stats, Walk & walk) {
+    stats.n_files++; //increments file counter
+
+    f.is_link = f.t.d_type == DT_LNK;
+    if (f.t.d_type == DT_UNKNOWN) {
+        struct stat lst;
+        stats.m.calls[STAT]++;
+        f.is_link = fstatat(f.t.at_fd(), f.t.name(), &lst, AT_SYMLINK_NOFOLLOW) == 0 && S_ISLNK(lst.st_mode);
+    }
+
+    f.readable = f.fd >= 0 && f.stat_ok && S_ISREG(f.st.st_mode);
+    //an inode is read once, however many paths lead to it, and its words
+    //are counted for each of them (see InodeSet); without symlinks only
+    //files with several links can have more than one path; approximate
+    //counts can't keep the words of every inode, there each path reads them
+    f.shared = f.readable && walk.inodes && (walk.follow_links || f.st.st_nlink >= 2) && ! stats.words_sketch;
+    f.first_path = ! f.shared || walk.inodes->claim(f.st, stats.words_hist);
+    //symlinks get their type from the link, so only files reached by their
+    //own name go through the cache, and only the path that has the words
+    const ScanCache * cache = walk.cache;
+    f.cacheable = cache && f.readable && ! f.is_link;
+    f.hit = f.cacheable ? cache->find(cache_key(f.st)) : nullptr;
+    f.cacheable = f.cacheable && f.first_path;
+    f.head.clear();
+    f.tail.clear();
+    //the words of a shared inode are kept apart until it is settled
+    f.per_file = f.shared && f.first_path;
+    if (f.per_file) f.words.clear();
+    if (f.hit) {
+        stats.m.cache_hits++;
+        const CacheWord * w = cache->words(*f.hit);
+        for (uint64_t i = 0; f.first_path && i < f.hit->n_words; i++) {
+            if (stats.words_sketch) stats.words_sketch->add(cache->str(w[i].str), w[i].count);
+            else (f.per_file ? f.words : stats.words_hist).add(cache->str(w[i].str), w[i].count);
+        }
+        return false;
+    }
+    if (! f.readable) {
+        if (f.stat_ok && S_ISREG(f.st.st_mode)) printf("ERROR: Couldn't read file\n");
+        return false;
+    }
+    if (! f.first_path) {
+        read_edges(f, stats);
+        return false;
+    }
+    //with a cache the words of the file are kept apart, to be stored, and
+    //the sketch gets one update per distinct word of the file (in batches
+    //of at most its capacity, see feed_file()); approximate counts don't
+    //store new files in the cache, that would keep all their words
+    if (stats.words_sketch) f.cacheable = false;
+    if (! f.per_file && (f.cacheable || stats.words_sketch)) {
+        f.per_file = true;
+        f.words.clear();
+    }
+    f.counter.len = 0;
+    return true;
+}
+
+// the next block of the file: goes to the word counter and (while the first
+// SNIFF_SIZE bytes are coming in) the type detection, the first and last
+// EDGE_SIZE bytes also go into the partial hash used to find duplicates
+static void feed_file(FileScan & f, Stats & stats, const unsigned char * b, size_t n) {
+    PhaseTimer timer { stats.m.ns[TOKENIZE] };
+    stats.m.bytes_read += n;
+    if (f.head.size() < SNIFF_SIZE)
+        f.head.insert(f.head.end(), b, b + std::min(n, SNIFF_SIZE - f.head.size()));
+    f.counter.feed(b, n, f.per_file ? f.words : stats.words_hist);
+    keep_tail(f.tail, b, n);
+    //the words of a file are not kept for the sketch beyond its own size
+    //(and one block's worth)
+    if (stats.words_sketch && f.words.size() >= stats.words_sketch->capacity()) {
+        f.words.for_each([&](std::string_view w, int count) { stats.words_sketch->add(w, count); });
+        f.words.clear();
+    }
+}
+
+// collects type and size once everything has been read, the fd is left open
+static void finish_file(FileScan & f, Stats & stats, Walk & walk) {
+    const ScanCache * cache = walk.cache;
+    if (f.readable && ! f.hit && f.first_path) {
+        f.counter.finish(f.per_file ? f.words : stats.words_hist);
+        if (stats.words_sketch)
+            f.words.for_each([&](std::string_view w, int count) { stats.words_sketch->add(w, count); });
+        else if (f.cacheable && ! f.shared)
+            stats.words_hist.add(f.words);
+    }
+    if (f.shared && f.first_path) walk.inodes->settle(f.st, f.words, stats.words_hist);
+
+    long start = now_ns();
+    std::string ftype;
+    if (f.hit) ftype = cache->str(f.hit->type);
+    else if (f.is_link) ftype = symlink_type(f.t.at_fd(), f.t.name(), ! f.stat_ok);
+    else if (! f.stat_ok) ftype = "cannot open";
+    else ftype = get_file_type(f.st, f.readable ? f.fd : -1, f.head.data(), f.head.size());
+    stats.m.ns[FILE_TYPE] += now_ns() - start;
+    //adds a count to the file type hashmap
+    if (stats.types_sketch) stats.types_sketch->add(ftype);
+    else stats.types_hist[ftype]++;
+
+    //check file size - add to total sum, check if largest
+    const Task & t = f.t;
+    long bytes = f.stat_ok ? f.st.st_size : 0;
+    stats.all_files_size += bytes; //adds size to total sum
+    //if it's larger we record it, on a tie the file visited first wins
+    if(bytes > stats.largest_file_size || (bytes == stats.largest_file_size && visited_before(t.path, stats.largest_file))) {
+        stats.largest_file_size = bytes;
+        stats.largest_file = t.path;
+    }
+
+    //duplicates are looked for after the merge, files we could not read are left out
+    if (f.readable) {
+        FileRecord r;
+        r.size = bytes;
+        r.path = t.path;
+        r.key = cache_key(f.st);
+        if (f.hit) {
+            r.partial = f.hit->partial;
+            if (f.hit->has_sha) r.hash = sha_to_hex(f.hit->sha);
+        }
+        else {
+            r.partial = fnv1a((const unsigned char *) &bytes, sizeof(bytes));
+            r.partial = fnv1a(f.head.data(), std::min(f.head.size(), EDGE_SIZE), r.partial);
+            r.partial = fnv1a(f.tail.data(), f.tail.size(), r.partial);
+        }
+        if (f.cacheable) {
+            r.cacheable = true;
+            r.cached = f.hit;
+            if (! f.hit) {
+                r.type = ftype;
+                r.words.reserve(f.words.size());
+                f.words.for_each([&](std::string_view w, int count) { r.words.emplace_back(w, count); });
+            }
+        }
+        stats.files.push_back(std::move(r));
+    }
+}
+
+// collects words, type and size of a single file in one pass, reading it
+// with plain read()s (t is moved from)
+static void visit_file(Task & t, int fd, const struct stat & st, bool stat_ok,
+                       Stats & stats, Scratch & sc, Walk & walk) {
+    FileScan & f = sc.file;
+    f.t = std::move(t);
+    f.fd = fd;
+    f.st = st;
+    f.stat_ok = stat_ok;
+    if (start_file(f, stats, walk)) {
+        while (1) {
+            stats.m.calls[READ_CALL]++;
+            long start = now_ns();
+            ssize_t len = read(fd, sc.buf.data(), sc.buf.size());
+            stats.m.ns[READ] += now_ns() - start;
+            if (len < 0 && errno == EINTR) continue;
+            if (len <= 0) break;
+            feed_file(f, stats, sc.buf.data(), len);
+        }
+    }
+    finish_file(f, stats, walk);
+}
+
+// the layout getdents64() fills the buffer with, glibc does not declare it
+struct linux_dirent64 {
+    uint64_t d_ino;
+    int64_t d_off;
+    unsigned short d_reclen;
+    unsigned char d_type;
+    char d_name[];
+};
+
+// counts a directory and queues its entries
+//    fd = the directory opened for reading, or -1 if that failed; it is
+//         closed here or by the last of the entries' tasks
+//    buf = scratch space, the entries are read in batches as large as it is
+//    dst = its fstat() if the caller has it already
+static void visit_dir(const Task & t, int fd, bool is_root, Stats & st, Walk & walk, int w,
+                      std::vector<unsigned char> & buf, const struct stat * dst = nullptr) {
+    if(! is_root) st.n_dirs++; //increments directory counter
+    if (fd < 0) return;
+    PhaseTimer timer { st.m.ns[TRAVERSE] };
+
+    //reads the entries of the directory, to visit them later
+    std::vector<std::pair<PathNode *,unsigned char>> entries;
+    while (1) {
+        st.m.calls[GETDENTS]++;
+        long len = syscall(SYS_getdents64, fd, buf.data(), buf.size());
+        if (len < 0 && errno == EINTR) continue;
+        if (len <= 0) break;
+        for (long off = 0; off < len; ) {
+            auto de = (const linux_dirent64 *) (buf.data() + off);
+            off += de->d_reclen;
+            const char * name = de->d_name;
+            if (name[0] == '.' && (name[1] == 0 || (name[1] == '.' && name[2] == 0))) continue;
+            entries.emplace_back(st.paths.add(t.path, name), de->d_type);
+        }
+    }
+    //the entries are opened relative to this directory, unless too many
+    //directories are open already, then they fall back to their full path
+    //symlinks below are checked against this directory and those above
+    std::shared_ptr<const DirId> ids;
+    struct stat own;
+    if (walk.follow_links && ! entries.empty()) {
+        if (! dst) {
+            st.m.calls[STAT]++;
+            if (fstat(fd, &own) == 0) dst = &own;
+        }
+        ids = dst ? std::make_shared<const DirId>(DirId { dst->st_dev, dst->st_ino, t.dirs }) : t.dirs;
+    }
+    std::shared_ptr<DirFd> dir;
+    if (! entries.empty() && DirFd::n_open < dir_fd_limit()) dir = std::make_shared<DirFd>(fd);
+    else close(fd);
+    st.m.calls[CLOSE]++; //now or when the last entry is done
+    //the old stack visited the last entry first
+    for (size_t i = 0; i < entries.size(); i++) {
+        entries[i].first->rank = entries.size() - 1 - i;
+        Task child { entries[i].first, entries[i].second, dir, ids, "" };
+        if (! dir) child.full = full_path(child.path);
+        walk.queues.push(w, std::move(child));
+    }
+}
+
+// opens an entry once and hands it to visit_dir() or visit_file(); the
+// d_type from the parent is trusted when the filesystem fills it in, so
+// directories need no stat() and special files are never opened
+static void visit(Task & t, Stats & stats, Walk & walk, int w, Scratch & sc) {
+    int dir_fd = t.at_fd();
+    const char * name = t.name();
+    bool is_root = t.path->dir == nullptr;
+    int fd = -1;
+    struct stat st;
+    bool stat_ok;
+    long start = now_ns();
+    switch (t.d_type) {
+    case DT_DIR:
+        stats.m.calls[OPEN]++;
+        fd = openat(dir_fd, name, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+        stats.m.ns[OPEN_STAT] += now_ns() - start;
+        visit_dir(t, fd, is_root, stats, walk, w, sc.buf);
+        return;
+    case DT_FIFO: case DT_SOCK: case DT_CHR: case DT_BLK:
+        stats.m.calls[STAT]++;
+        stat_ok = fstatat(dir_fd, name, &st, AT_SYMLINK_NOFOLLOW) == 0;
+        break;
+    default: //regular files, symlinks and unknown entries
+        if (! walk.follow_links && ! is_root && t.d_type != DT_REG) {
+            stats.m.calls[STAT]++;
+            stat_ok = fstatat(dir_fd, name, &st, AT_SYMLINK_NOFOLLOW) == 0;
+            if (stat_ok && S_ISLNK(st.st_mode)) break; //the link itself is the file
+        }
+        //O_NONBLOCK so that opening a fifo does not hang
+        stats.m.calls[OPEN]++;
+        stats.m.calls[STAT]++;
+        fd = openat(dir_fd, name, O_RDONLY | O_NONBLOCK | O_CLOEXEC | O_NOCTTY);
+        stat_ok = fd >= 0 ? fstat(fd, &st) == 0 : fstatat(dir_fd, name, &st, 0) == 0;
+        if (stat_ok && S_ISDIR(st.st_mode)) { //if the current name is a directory and not a file
+            if (! on_path(t.dirs.get(), st)) {
+                stats.m.ns[OPEN_STAT] += now_ns() - start;
+                visit_dir(t, fd, is_root, stats, walk, w, sc.buf, &st);
+                return;
+            }
+            //a symlink back up to a directory it is in would be walked
+            //forever, it is reported as the link itself instead
+            stats.m.calls[CLOSE]++;
+            close(fd);
+            fd = -1;
+            stats.m.calls[STAT]++;
+            stat_ok = fstatat(dir_fd, name, &st, AT_SYMLINK_NOFOLLOW) == 0;
+        }
+    }
+    stats.m.ns[OPEN_STAT] += now_ns() - start;
+    //if the current name is a file, we need to obtain all needed info
+    visit_file(t, fd, st, stat_ok, stats, sc, walk);
+    if (fd >= 0) {
+        stats.m.calls[CLOSE]++;
+        close(fd);
+    }
+}
+
+// -----------------------------------------------------------------------------
+// io_uring backend
+//
+// a worker with a ring keeps up to DIRSTATS_URING (default 32) regular files
+// in flight: the openat() and statx() of a file are submitted together, then
+// its reads one block at a time, and every completion is fed to the file's
+// FileScan; on high-latency storage this keeps the device queue full from a
+// few threads. The kernel is talked to with the raw syscalls (glibc has no
+// wrappers), and without io_uring (an old kernel, seccomp, DIRSTATS_URING=0)
+// workers visit every file synchronously
+constexpr unsigned RING_FILES = 32; // files in flight per worker by default
+constexpr size_t RING_READ_SIZE = 128 * 1024; // bytes per read of a file in flight
+
+// files in flight per worker, 0 for no io_uring
+static unsigned ring_depth() {
+    const char * s = getenv("DIRSTATS_URING");
+    if (! s) return RING_FILES;
+    int n = atoi(s);
+    return n > 0 ? n : 0;
+}
+
+// a submission and a completion queue shared with the kernel
+class IoRing {
+    int fd_ = -1;
+    void * sq_ptr_ = MAP_FAILED, * cq_ptr_ = MAP_FAILED, * sqes_ptr_ = MAP_FAILED;
+    size_t sq_size_ = 0, cq_size_ = 0, sqes_size_ = 0;
+    unsigned * sq_head_, * sq_tail_, * sq_mask_, * sq_array_, sq_entries_ = 0;
+    unsigned * cq_head_, * cq_tail_, * cq_mask_;
+    io_uring_sqe * sqes_;
+    io_uring_cqe * cqes_;
+    unsigned tail_ = 0, queued_ = 0; // our tail, and how many sqes since the last submit
+
+    template <class T> static T * at(void * base, unsigned off) { return (T *) ((char *) base + off); }
+    // whether the kernel knows all the operations
+    bool supports(std::initializer_list<int> ops) {
+        std::vector<unsigned char> buf(sizeof(io_uring_probe) + 256 * sizeof(io_uring_probe_op));
+        auto probe = (io_uring_probe *) buf.data();
+        if (syscall(__NR_io_uring_register, fd_, IORING_REGISTER_PROBE, probe, 256) < 0) return false;
+        for (int op : ops)
+            if (op > probe->last_op || ! (probe->ops[op].flags & IO_URING_OP_SUPPORTED)) return false;
+        return true;
+    }
+    void release() {
+        if (sqes_ptr_ != MAP_FAILED) munmap(sqes_ptr_, sqes_size_);
+        if (cq_ptr_ != MAP_FAILED && cq_ptr_ != sq_ptr_) munmap(cq_ptr_, cq_size_);
+        if (sq_ptr_ != MAP_FAILED) munmap(sq_ptr_, sq_size_);
+        if (fd_ >= 0) close(fd_);
+        fd_ = -1;
+    }
+
+    public:
+    explicit IoRing(unsigned entries) {
+        io_uring_params p;
+        memset(&p, 0, sizeof(p));
+        fd_ = syscall(__NR_io_uring_setup, entries, &p);
+        if (fd_ < 0) return;
+        sq_size_ = p.sq_off.array + p.sq_entries * sizeof(unsigned);
+        cq_size_ = p.cq_off.cqes + p.cq_entries * sizeof(io_uring_cqe);
+        bool single = p.features & IORING_FEAT_SINGLE_MMAP;
+        if (single) sq_size_ = cq_size_ = std::max(sq_size_, cq_size_);
+        sq_ptr_ = mmap(nullptr, sq_size_, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd_, IORING_OFF_SQ_RING);
+        cq_ptr_ = single ? sq_ptr_
+            : mmap(nullptr, cq_size_, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd_, IORING_OFF_CQ_RING);
+        sqes_size_ = p.sq_entries * sizeof(io_uring_sqe);
+        sqes_ptr_ = mmap(nullptr, sqes_size_, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd_, IORING_OFF_SQES);
+        if (sq_ptr_ == MAP_FAILED || cq_ptr_ == MAP_FAILED || sqes_ptr_ == MAP_FAILED
+            || ! supports({ IORING_OP_OPENAT, IORING_OP_STATX, IORING_OP_READ })) {
+            release();
+            return;
+        }
+        sq_head_ = at<unsigned>(sq_ptr_, p.sq_off.head);
+        sq_tail_ = at<unsigned>(sq_ptr_, p.sq_off.tail);
+        sq_mask_ = at<unsigned>(sq_ptr_, p.sq_off.ring_mask);
+        sq_array_ = at<unsigned>(sq_ptr_, p.sq_off.array);
+        sq_entries_ = p.sq_entries;
+        cq_head_ = at<unsigned>(cq_ptr_, p.cq_off.head);
+        cq_tail_ = at<unsigned>(cq_ptr_, p.cq_off.tail);
+        cq_mask_ = at<unsigned>(cq_ptr_, p.cq_off.ring_mask);
+        cqes_ = at<io_uring_cqe>(cq_ptr_, p.cq_off.cqes);
+        sqes_ = (io_uring_sqe *) sqes_ptr_;
+        tail_ = *sq_tail_;
+    }
+    ~IoRing() { release(); }
+    IoRing(const IoRing &) = delete;
+    IoRing & operator=(const IoRing &) = delete;
+
+    bool ok() const { return fd_ >= 0; }
+    // a cleared sqe to fill in, nullptr if the submission queue is full
+    io_uring_sqe * sqe() {
+        if (tail_ - __atomic_load_n(sq_head_, __ATOMIC_ACQUIRE) >= sq_entries_) return nullptr;
+        unsigned i = tail_ & *sq_mask_;
+        sq_array_[i] = i;
+        tail_++;
+        queued_++;
+        memset(&sqes_[i], 0, sizeof(io_uring_sqe));
+        return &sqes_[i];
+    }
+    // hands the new sqes to the kernel, and waits for at least wait_nr completions
+    void submit(unsigned wait_nr) {
+        __atomic_store_n(sq_tail_, tail_, __ATOMIC_RELEASE);
+        while (1) {
+            long n = syscall(__NR_io_uring_enter, fd_, queued_, wait_nr, wait_nr ? IORING_ENTER_GETEVENTS : 0, nullptr, 0);
+            if (n < 0 && errno == EINTR) continue;
+            if (n > 0) queued_ -= std::min<unsigned>(n, queued_);
+            return;
+        }
+    }
+    // takes the next completion, false if there is none
+    bool pop(io_uring_cqe & c) {
+        unsigned head = *cq_head_;
+        if (head == __atomic_load_n(cq_tail_, __ATOMIC_ACQUIRE)) return false;
+        c = cqes_[head & *cq_mask_];
+        __atomic_store_n(cq_head_, head + 1, __ATOMIC_RELEASE);
+        return true;
+    }
+};
+
+static void statx_to_stat(const struct statx & x, struct stat & st) {
+    memset(&st, 0, sizeof(st));
+    st.st_dev = makedev(x.stx_dev_major, x.stx_dev_minor);
+    st.st_ino = x.stx_ino;
+    st.st_mode = x.stx_mode;
+    st.st_nlink = x.stx_nlink;
+    st.st_uid = x.stx_uid;
+    st.st_gid = x.stx_gid;
+    st.st_rdev = makedev(x.stx_rdev_major, x.stx_rdev_minor);
+    st.st_size = x.stx_size;
+    st.st_mtim.tv_sec = x.stx_mtime.tv_sec;
+    st.st_mtim.tv_nsec = x.stx_mtime.tv_nsec;
+}
+
+// the regular files one worker has in flight
+class AsyncFiles {
+    enum Op { OPEN, STATX, READ };
+    struct Slot {
+        FileScan f;
+        struct statx stx;
+        int waiting = 0; // completions to come before the file can be read
+        int open_res = -1, statx_res = -1;
+        off_t offset = 0;
+        std::vector<unsigned char> buf = std::vector<unsigned char>(RING_READ_SIZE);
+    };
+    IoRing ring_;
+    std::vector<Slot> slots_;
+    std::vector<uint32_t> free_;
+    unsigned reads_ = 0; // in flight
+    Stats & stats_;
+    Walk & walk_;
+    int w_;
+
+    io_uring_sqe * sqe(uint32_t slot, Op op) {
+        io_uring_sqe * e = ring_.sqe();
+        if (! e) { //cannot happen, every slot has at most two sqes queued
+            ring_.submit(0);
+            e = ring_.sqe();
+        }
+        e->user_data = uint64_t(slot) << 2 | op;
+        return e;
+    }
+    void read(uint32_t i) {
+        Slot & s = slots_[i];
+        stats_.m.calls[READ_CALL]++;
+        reads_++;
+        io_uring_sqe * e = sqe(i, READ);
+        e->opcode = IORING_OP_READ;
+        e->fd = s.f.fd;
+        e->addr = (uint64_t) s.buf.data();
+        e->len = s.buf.size();
+        e->off = s.offset;
+    }
+    void done(uint32_t i) {
+        Slot & s = slots_[i];
+        finish_file(s.f, stats_, walk_);
+        if (s.f.fd >= 0) {
+            stats_.m.calls[CLOSE]++;
+            close(s.f.fd);
+        }
+        s.f.t = Task(); //lets go of the parent directory
+        free_.push_back(i);
+        walk_.queues.done();
+    }
+    // the open and the statx have both completed
+    void opened(uint32_t i) {
+        Slot & s = slots_[i];
+        FileScan & f = s.f;
+        f.fd = s.open_res >= 0 ? s.open_res : -1;
+        f.stat_ok = s.statx_res == 0;
+        if (f.stat_ok) statx_to_stat(s.stx, f.st);
+        if (f.stat_ok && S_ISDIR(f.st.st_mode)) { //d_type was out of date
+            Task t = std::move(f.t);
+            visit_dir(t, f.fd, false, stats_, walk_, w_, s.buf, &f.st);
+            f.fd = -1;
+            free_.push_back(i);
+            walk_.queues.done();
+            return;
+        }
+        //it was opened O_NONBLOCK in case it is a fifo after all, which a
+        //regular file must not be for its reads to wait for the disk
+        if (f.fd >= 0 && f.stat_ok && S_ISREG(f.st.st_mode)) fcntl(f.fd, F_SETFL, 0);
+        if (start_file(f, stats_, walk_)) {
+            s.offset = 0;
+            read(i);
+        }
+        else done(i);
+    }
+    void complete(const io_uring_cqe & c) {
+        uint32_t i = c.user_data >> 2;
+        Slot & s = slots_[i];
+        switch (Op(c.user_data & 3)) {
+        case OPEN:
+            s.open_res = c.res;
+            if (--s.waiting == 0) opened(i);
+            break;
+        case STATX:
+            s.statx_res = c.res;
+            if (--s.waiting == 0) opened(i);
+            break;
+        case READ:
+            reads_--;
+            if (c.res == -EINTR || c.res == -EAGAIN) read(i);
+            else if (c.res <= 0) done(i);
+            else {
+                feed_file(s.f, stats_, s.buf.data(), c.res);
+                s.offset += c.res;
+                read(i);
+            }
+            break;
+        }
+    }
+
+    public:
+    AsyncFiles(unsigned depth, Stats & stats, Walk & walk, int w)
+        : ring_(2 * depth), slots_(ring_.ok() ? depth : 0), stats_(stats), walk_(walk), w_(w) {
+        for (uint32_t i = slots_.size(); i-- > 0; ) {
+            free_.push_back(i);
+            slots_[i].f.head.reserve(SNIFF_SIZE);
+        }
+    }
+    bool ok() const { return ring_.ok(); }
+    bool full() const { return free_.empty(); }
+    bool idle() const { return free_.size() == slots_.size(); }
+    // starts on a regular file, the worker is done() with it once it completes
+    void add(Task && t) {
+        uint32_t i = free_.back();
+        free_.pop_back();
+        Slot & s = slots_[i];
+        s.f.t = std::move(t);
+        s.waiting = 2;
+        stats_.m.calls[OPEN]++;
+        stats_.m.calls[STAT]++;
+        //O_NONBLOCK so that opening a fifo does not hang
+        io_uring_sqe * e = sqe(i, OPEN);
+        e->opcode = IORING_OP_OPENAT;
+        e->fd = s.f.t.at_fd();
+        e->addr = (uint64_t) s.f.t.name();
+        e->open_flags = O_RDONLY | O_NONBLOCK | O_CLOEXEC | O_NOCTTY;
+        e = sqe(i, STATX);
+        e->opcode = IORING_OP_STATX;
+        e->fd = s.f.t.at_fd();
+        e->addr = (uint64_t) s.f.t.name();
+        e->len = STATX_BASIC_STATS;
+        e->off = (uint64_t) &s.stx;
+    }
+    // submits what was queued and handles whatever has completed, waiting
+    // for at least one completion if wait is set
+    void run(bool wait) {
+        stats_.m.calls[URING_ENTER]++;
+        {
+            //the kernel does the reading meanwhile
+            PhaseTimer timer { stats_.m.ns[reads_ ? ::READ : IO_WAIT] };
+            ring_.submit(wait ? 1 : 0);
+        }
+        io_uring_cqe c;
+        while (ring_.pop(c)) complete(c);
+    }
+};
+
+// SHA-256 of a whole file as lowercase hex, "" if it cannot be read
+static std::string sha256_of_file(const std::string & path, std::vector<unsigned char> & buf) {
+    int fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0) return "";
+    Sha256 sha;
+    while (1) {
+        ssize_t len = read(fd, buf.data(), buf.size());
+        if (len < 0 && errno == EINTR) continue;
+        if (len <= 0) break;
+        sha.update(buf.data(), len);
+    }
+    close(fd);
+    return sha.hex_digest();
+}
+
+#ifdef DIRSTATS_X86_DISPATCH
+// hashes files 8 at a time with the AVX2 kernel, one per lane; a lane that
+// is done with its file takes the next, so that small files are batched
+// together rather than each hashed alone
+//    next() = the next file to hash, nullptr when there are no more; its
+//             hash is set to "" if it cannot be opened
+template <class Next>
+static void sha256_files_x8(Next next) {
+    constexpr size_t LANE_BUF = 64 * 1024; // bytes read at a time per lane
+    struct Lane {
+        FileRecord * f = nullptr;
+        int fd = -1;
+        uint64_t len = 0; // bytes of the file read so far
+        size_t pos = 0, end = 0; // what is still to hash in buf
+        bool padded = false; // the file has been read to the end and padded
+        std::vector<unsigned char> buf = std::vector<unsigned char>(LANE_BUF + 128);
+    };
+    Lane lanes[8];
+    uint32_t st[8][8]; // st[i][k] = word i of the state of lane k
+    const std::vector<unsigned char> idle(LANE_BUF + 128); // hashed by lanes with nothing to do
+
+    //opens the next file in a lane
+    auto start = [&](int k) {
+        Lane & l = lanes[k];
+        while ((l.f = next())) {
+            l.fd = open(full_path(l.f->path).c_str(), O_RDONLY | O_CLOEXEC);
+            if (l.fd >= 0) break;
+            l.f->hash = "";
+        }
+        l.len = l.pos = l.end = 0;
+        l.padded = false;
+        for (int i = 0; i < 8; i++) st[i][k] = sha256_init[i];
+    };
+    //makes sure a lane has a whole block to hash, false once its file is
+    //hashed to the end
+    auto fill = [&](Lane & l) {
+        if (l.end - l.pos >= 64) return true;
+        if (l.padded) return false;
+        //a partial block is left over at most, moved to the front
+        memmove(l.buf.data(), l.buf.data() + l.pos, l.end - l.pos);
+        l.end -= l.pos;
+        l.pos = 0;
+        bool eof = false;
+        while (l.end < LANE_BUF) {
+            ssize_t n = read(l.fd, l.buf.data() + l.end, LANE_BUF - l.end);
+            if (n < 0 && errno == EINTR) continue;
+            if (n <= 0) {
+                eof = true;
+                break;
+            }
+            l.end += n;
+            l.len += n;
+        }
+        if (eof) {
+            size_t last = l.end - l.len % 64;
+            l.end = last + sha256_pad(l.buf.data() + last, l.len);
+            l.padded = true;
+        }
+        return true;
+    };
+
+    for (int k = 0; k < 8; k++) start(k);
+    while (1) {
+        size_t blocks = SIZE_MAX;
+        int active = 0, last = 0;
+        for (int k = 0; k < 8; k++) {
+            Lane & l = lanes[k];
+            while (l.f && ! fill(l)) {
+                uint32_t h[8];
+                for (int i = 0; i < 8; i++) h[i] = st[i][k];
+                l.f->hash = sha256_hex(h);
+                close(l.fd);
+                start(k);
+            }
+            if (! l.f) continue;
+            active++;
+            last = k;
+            blocks = std::min(blocks, (l.end - l.pos) / 64);
+        }
+        if (! active) break;
+        if (active == 1) { //a single stream is faster on its own
+            Lane & l = lanes[last];
+            uint32_t h[8];
+            for (int i = 0; i < 8; i++) h[i] = st[i][last];
+            blocks = (l.end - l.pos) / 64;
+            sha256_blocks_scalar(h, l.buf.data() + l.pos, blocks);
+            for (int i = 0; i < 8; i++) st[i][last] = h[i];
+            l.pos += 64 * blocks;
+            continue;
+        }
+        const unsigned char * p[8];
+        for (int k = 0; k < 8; k++) p[k] = lanes[k].f ? lanes[k].buf.data() + lanes[k].pos : idle.data();
+        sha256_blocks_avx2x8(st, p, blocks);
+        for (int k = 0; k < 8; k++)
+            if (lanes[k].f) lanes[k].pos += 64 * blocks;
+    }
+}
+#endif
+
+// staged duplicate search: files can only be duplicates if they have the
+// same size, and then only if their partial hashes (computed during the
+// scan) agree, so the full SHA-256 is computed (on n_workers threads) only
+// for files that still collide after both checks (and are not in the cache),
+// with SHA-NI one file at a time or AVX2 8 files at a time if the CPU can;
+// paths to the same inode share one hash
+// returns the groups of 2 or more files with the same SHA-256
+static std::unordered_map<std::string,std::vector<FileRecord *>>
+find_duplicates(std::vector<FileRecord *> & files, int n_workers, Counters & m) {
+    auto key = [](const FileRecord * f) { return std::make_pair(f->size, f->partial); };
+    std::sort(files.begin(), files.end(), [&](const FileRecord * a, const FileRecord * b) { return key(a) < key(b); });
+    std::vector<FileRecord *> candidates;
+    for (size_t i = 0, j; i < files.size(); i = j) {
+        for (j = i + 1; j < files.size() && key(files[j]) == key(files[i]); j++);
+        if (j - i > 1) candidates.insert(candidates.end(), files.begin() + i, files.begin() + j);
+    }
+
+    //one path per inode is hashed, unless the cache has the hash already
+    std::sort(candidates.begin(), candidates.end(),
+              [](const FileRecord * a, const FileRecord * b) { return a->key < b->key; });
+    std::vector<std::pair<size_t,size_t>> inodes; // ranges of candidates
+    std::vector<FileRecord *> todo;
+    auto unknown = [](const FileRecord * f) { return f->hash.empty(); };
+    for (size_t i = 0, j; i < candidates.size(); i = j) {
+        for (j = i + 1; j < candidates.size() && candidates[j]->key == candidates[i]->key; j++);
+        inodes.emplace_back(i, j);
+        if (std::all_of(candidates.begin() + i, candidates.begin() + j, unknown)) todo.push_back(candidates[i]);
+    }
+
+    std::atomic<size_t> next(0);
+    auto hasher = [&]() {
+#ifdef DIRSTATS_X86_DISPATCH
+        if (sha256_x8) {
+            sha256_files_x8([&]() -> FileRecord * {
+                size_t i = next++;
+                return i < todo.size() ? todo[i] : nullptr;
+            });
+            return;
+        }
+#endif
+        std::vector<unsigned char> buf(READ_SIZE);
+        for (size_t i; (i = next++) < todo.size(); )
+            todo[i]->hash = sha256_of_file(full_path(todo[i]->path), buf);
+    };
+    std::vector<std::thread> threads;
+    for (int w = 1; w < n_workers && size_t(w) < todo.size(); w++)
+        threads.emplace_back(hasher);
+    hasher();
+    for (auto & th : threads)
+        th.join();
+
+    m.hashed_files += todo.size();
+    for (auto & r : inodes) {
+        const std::string * hash = nullptr;
+        for (size_t i = r.first; i < r.second && ! hash; i++)
+            if (! candidates[i]->hash.empty()) hash = &candidates[i]->hash;
+        for (size_t i = r.first; hash && i < r.second; i++)
+            if (candidates[i]->hash.empty()) candidates[i]->hash = *hash;
+    }
+
+    std::unordered_map<std::string,std::vector<FileRecord *>> groups;
+    for (auto f : candidates)
+        if (! f->hash.empty()) groups[f->hash].push_back(f);
+    return groups;
+}
+
+// the Metrics of a run from what its workers counted
+static Metrics make_metrics(const Counters & m, long wall_ns, int n_workers, long n_files, long n_dirs) {
+    Metrics res = Metrics();
+    res.wall_ns = wall_ns;
+    res.workers = n_workers;
+    res.files = n_files;
+    res.dirs = n_dirs;
+    res.files_per_sec = wall_ns > 0 ? n_files * 1e9 / wall_ns : 0.0;
+    res.dirs_per_sec = wall_ns > 0 ? n_dirs * 1e9 / wall_ns : 0.0;
+    res.bytes_read = m.bytes_read;
+    res.cache_hits = m.cache_hits;
+    res.hashed_files = m.hashed_files;
+    for (int i = 0; i < N_PHASES; i++) res.*phase_fields[i] = m.ns[i];
+    for (int i = 0; i < N_CALLS; i++) res.*call_fields[i] = m.calls[i];
+    return res;
+}
+
+// the metrics of a run as a JSON object
+static std::string metrics_json(const Metrics & m) {
+    auto num = [](long v) { return std::to_string(v); };
+    auto rate = [](double v) {
+        char buf[32];
+        snprintf(buf, sizeof(buf), "%.1f", v);
+        return std::string(buf);
+    };
+    std::string js = "{\"wall_ns\": " + num(m.wall_ns) + ", \"workers\": " + num(m.workers)
+        + ", \"files\": " + num(m.files) + ", \"dirs\": " + num(m.dirs)
+        + ", \"files_per_sec\": " + rate(m.files_per_sec) + ", \"dirs_per_sec\": " + rate(m.dirs_per_sec)
+        + ", \"bytes_read\": " + num(m.bytes_read) + ", \"cache_hits\": " + num(m.cache_hits)
+        + ", \"hashed_files\": " + num(m.hashed_files) + ", \"phase_ns\": {";
+    for (int i = 0; i < N_PHASES; i++)
+        js += std::string(i ? ", " : "") + "\"" + phase_names[i] + "\": " + num(m.*phase_fields[i]);
+    js += "}, \"syscalls\": {";
+    for (int i = 0; i < N_CALLS; i++)
+        js += std::string(i ? ", " : "") + "\"" + call_names[i] + "\": " + num(m.*call_fields[i]);
+    return js + "}}";
+}
+
+// what getDirStats() and getDirStats_approx() do
+//         max_counters = 0 to count words and types exactly, or how many
+//                        of each to keep per worker when counting them
+//                        approximately
+//         word_errors = where to put how much the top word counts may be
+//                       too high, or nullptr
+//         metrics = where to put the metrics, or nullptr
+// every path is printed if DIRSTATS_VERBOSE is set to something other than
+// 0, and the metrics are written to the file DIRSTATS_METRICS names (- for
+// stderr)
+static Results dir_stats(const std::string & root_dir, int n, size_t max_counters, std::vector<long> * word_errors,
+                         Metrics * metrics)
+{
+    long start_ns = now_ns();
+    Results res;
+    //initializes values
+    res.all_files_size = 0;
+    res.n_files = 0;
+    res.n_dirs = 0;
+    res.largest_file_path = ""; //defaults to empty string if no files
+    res.largest_file_size = -1; //defaults to -1 if no files
+
+    if (! is_dir(root_dir)) { // if input directory isn't correct, returns empty results
+        if (metrics) *metrics = Metrics();
+        return res;
+    }
+    const char * verbose_env = getenv("DIRSTATS_VERBOSE");
+    bool verbose = verbose_env && *verbose_env && strcmp(verbose_env, "0") != 0;
+
+    // FOLLOWING SNIPPET MODIFIED FROM
+    // https://gitlab.com/cpsc457/public/find-empty-directories/-/blob/master/myfind.cpp
+    // SNIPPET Recursively examines a directory, finding and printing all files
+    // (spread over n_workers threads)
+    int n_workers = worker_count();
+    //files that did not change since the last scan come from the cache
+    const char * cache_path = getenv("DIRSTATS_CACHE");
+    std::unique_ptr<ScanCache> cache;
+    if (cache_path && *cache_path) cache.reset(new ScanCache(cache_path));
+    WorkQueues queues(n_workers);
+    InodeSet inodes;
+    Walk walk { queues, cache.get(), follow_symlinks(), &inodes };
+    std::vector<Stats> stats(n_workers);
+    if (max_counters)
+        for (auto & st : stats) {
+            st.words_sketch.reset(new TopKSketch(max_counters));
+            st.types_sketch.reset(new TopKSketch(max_counters));
+        }
+    Task root;
+    root.path = stats[0].paths.add(nullptr, root_dir);
+    root.full = root_dir;
+    queues.push(0, std::move(root)); //adds base directory to start
+    unsigned depth = ring_depth();
+    auto worker = [&](int w) {
+        Scratch sc;
+        sc.file.head.reserve(SNIFF_SIZE);
+        //regular files go through io_uring if there is one
+        std::unique_ptr<AsyncFiles> async;
+        if (depth) async.reset(new AsyncFiles(depth, stats[w], walk, w));
+        if (async && ! async->ok()) async.reset();
+        Task t;
+        while (1) {
+            if (async && async->full()) {
+                async->run(true);
+                continue;
+            }
+            if (! queues.pop(w, t)) {
+                if (async && ! async->idle()) async->run(true);
+                else if (! queues.wait()) break;
+                continue;
+            }
+            if (verbose) printf("%s\n", full_path(t.path).c_str());
+            if (async && t.d_type == DT_REG) {
+                async->add(std::move(t));
+                async->run(false);
+                continue;
+            }
+            visit(t, stats[w], walk, w, sc);
+            queues.done();
+        }
+    };
+    std::vector<std::thread> threads;
+    for (int w = 1; w < n_workers; w++)
+        threads.emplace_back(worker, w);
+    worker(0);
+    for (auto & th : threads)
+        th.join();
+
+    //merge what the workers found
+    WordTable words_hist;
+    std::unordered_map<std::string,int> types_hist;
+    std::vector<FileRecord *> files;
+    const PathNode * largest_file = nullptr;
+    Counters m;
+    for (auto & st : stats) {
+        m.add(st.m);
+        res.n_files += st.n_files;
+        res.n_dirs += st.n_dirs;
+        res.all_files_size += st.all_files_size;
+        if (st.largest_file_size > res.largest_file_size
+            || (st.largest_file_size == res.largest_file_size && largest_file && visited_before(st.largest_file, largest_file))) {
+            res.largest_file_size = st.largest_file_size;
+            res.largest_file_path = full_path(st.largest_file);
+            largest_file = st.largest_file;
+        }
+        words_hist.add(st.words_hist);
+        for (auto & h : st.types_hist) types_hist[h.first] += h.second;
+        if (max_counters && &st != &stats[0]) {
+            stats[0].words_sketch->merge(*st.words_sketch);
+            stats[0].types_sketch->merge(*st.types_sketch);
+        }
+        for (auto & f : st.files) files.push_back(&f);
+    }
+    long phase_start = now_ns();
+    auto hash_hist = find_duplicates(files, n_workers, m);
+    m.ns[FULL_HASH] += now_ns() - phase_start;
+    if (cache) {
+        PhaseTimer timer { m.ns[CACHE_WRITE] };
+        std::vector<const FileRecord *> cacheable;
+        for (auto f : files)
+            if (f->cacheable) cacheable.push_back(f);
+        write_scan_cache(cache_path, cacheable, *cache);
+    }
+    phase_start = now_ns();
+
+    //We have gathered all the information, now we need to process it
+    //most common words and types need to be sorted and cropped
+
+    //the sketches already know their top entries, in the same order
+    if (max_counters) {
+        for (auto & e : stats[0].words_sketch->top(n)) {
+            res.most_common_words.emplace_back(std::get<0>(e), std::get<1>(e));
+            if (word_errors) word_errors->push_back(std::get<2>(e));
+        }
+        for (auto & e : stats[0].types_sketch->top(n))
+            res.most_common_types.emplace_back(std::get<0>(e), std::get<1>(e));
+    }
+    //otherwise the exact counts are sorted
+    else {
+        // first we place the words and counts into array (with count
+        // negative to reverse the sort), the words still point into the table
+        std::vector<std::pair<int,std::string_view>> arr1;
+        arr1.reserve(words_hist.size());
+        words_hist.for_each([&](std::string_view w, int count) { arr1.emplace_back(-count, w); });
+        // if we have more than N entries, we'll sort partially, since
+        // we only need the first N to be sorted
+        if(arr1.size() > size_t(n)) {
+            std::partial_sort(arr1.begin(), arr1.begin() + n, arr1.end());
+            // drop all entries after the first n
+            arr1.resize(n);
+        } else {
+            std::sort(arr1.begin(), arr1.end());
+        }
+        //now we insert these into the results vector
+        for(auto & p : arr1) {
+            res.most_common_words.emplace_back(std::string(p.second), -p.first);
+        }
+
+        std::vector<std::pair<int,std::string>> arr2;
+        for(auto & h : types_hist)
+            arr2.emplace_back(-h.second, h.first);
+        // if we have more than N entries, we'll sort partially, since
+        // we only need the first N to be sorted
+        if(arr2.size() > size_t(n)) {
+            std::partial_sort(arr2.begin(), arr2.begin() + n, arr2.end());
+            // drop all entries after the first n
+            arr2.resize(n);
+        } else {
+            std::sort(arr2.begin(), arr2.end());
+        }
+        //now we insert these into the results vector
+        for(auto & p : arr2) {
+            res.most_common_types.emplace_back(p.second, -p.first);
+        }
+    }
+    
+    //duplicates - uses second approach
+    std::set<std::pair<int,std::vector<std::string>>> mmq; //min/max queue
+    for(auto & h : hash_hist) {
+        if(h.second.size() > 1) { //if duplicates were found
+            //list the files in the order the single-threaded walk found them
+            std::sort(h.second.begin(), h.second.end(),
+                [](const FileRecord * a, const FileRecord * b) { return visited_before(a->path, b->path); });
+            std::vector<std::string> paths;
+            for(auto f : h.second) paths.push_back(full_path(f->path));
+            mmq.emplace(-(h.second.size()), paths); //puts in a pair that includes the # of duplicates and the array of file names
+        }
+        if(mmq.size() > size_t(n)) //if the queue is too big, dump the lowest
+            mmq.erase(std::prev(mmq.end()));
+    } 
+    for(auto & v : mmq) { //pulls just the string vectors and puts them in the duplicate files
+        res.duplicate_files.push_back(v.second);
+    }
+    
+    m.ns[REPORT] += now_ns() - phase_start;
+    const char * metrics_path = getenv("DIRSTATS_METRICS");
+    if (metrics || (metrics_path && *metrics_path)) {
+        Metrics all = make_metrics(m, now_ns() - start_ns, n_workers, res.n_files, res.n_dirs);
+        if (metrics_path && *metrics_path) {
+            FILE * out = strcmp(metrics_path, "-") == 0 ? stderr : fopen(metrics_path, "w");
+            if (out) {
+                fprintf(out, "%s\n", metrics_json(all).c_str());
+                if (out != stderr) fclose(out);
+            }
+        }
+        if (metrics) *metrics = all;
+    }
+
+    //everything done!!!
+    return res;
+}
+
+// -----------------------------------------------------------------------------
+// watch mode
+//
+// getDirStats_watch_start() scans the tree once into a model that keeps what
+// every entry contributed to the stats, then a thread of its own follows
+// inotify events and rescans only the entries they name, taking out what
+// they contributed before and adding what they contribute now; a query just
+// sorts out the top n of the counts kept up to date this way
+//
+// files are read the same way as by the scan (visit_file() into a Stats of
+// their own), and the contents of an inode are read once for all its paths,
+// while its words count once for each of them; the model differs from a
+// fresh scan only where the scan goes by the order it visits files in:
+// paths inside a duplicate group are sorted by name and of several largest
+// files the first by name is reported
+//
+// inotify does not see changes made through a followed symlink to a file
+// outside the tree, and a directory that could not get a watch (e.g. over
+// fs.inotify.max_user_watches) is only rescanned with its parent
+constexpr uint32_t WATCH_EVENTS = IN_CREATE | IN_DELETE | IN_MOVED_FROM | IN_MOVED_TO | IN_MODIFY
+    | IN_CLOSE_WRITE | IN_ATTRIB | IN_DELETE_SELF | IN_MOVE_SELF;
+constexpr int WATCH_SETTLE_MS = 100; // rescans wait until events stop for this long
+constexpr long WATCH_MAX_DELAY_NS = 1000000000L; // but not longer than this
+
+struct WatchDir;
+struct WatchInode;
+
+// a file or directory in a watched directory
+struct WatchEntry {
+    WatchDir * in; // the directory it is in
+    const std::string * name; // its key in in->entries
+    std::unique_ptr<WatchDir> dir; // set for a directory (symlinks to them included if followed)
+    long size = 0; // what it adds to the total size
+    std::string type;
+    WatchInode * inode = nullptr; // its contents, for a regular file that could be read
+    bool is_link = false;
+    dev_t to_dev = 0; // what a followed symlink leads to, to_ino = 0 if nothing
+    ino_t to_ino = 0;
+};
+
+struct WatchDir {
+    WatchEntry * entry; // nullptr for the root
+    dev_t dev;
+    ino_t ino;
+    int wd = -1; // its inotify watch, -1 if it has none
+    std::map<std::string,WatchEntry> entries;
+};
+
+// what the contents of a regular file contributed, shared by its paths
+struct WatchInode {
+    CacheKey key; // another size or mtime means new contents
+    std::string type; // for the paths that are not symlinks
+    uint64_t partial;
+    std::string hash; // SHA-256, once another file has the same size and partial
+    std::vector<std::pair<std::string,int>> words;
+    std::vector<WatchEntry *> entries; // the paths to it
+};
+
+class DirWatch {
+    std::string root_path_;
+    bool follow_links_ = follow_symlinks();
+    int inotify_ = -1, stop_ = -1; // stop_ is an eventfd that ends the thread
+    std::thread thread_;
+
+    // the model, everything below is guarded by m_
+    std::mutex m_;
+    std::unique_ptr<WatchDir> root_;
+    std::unordered_map<int,std::vector<WatchDir *>> watched_; // several if a symlink leads to it
+    std::map<std::pair<uint64_t,uint64_t>,WatchInode> inodes_; // by (dev, ino)
+    std::unordered_map<std::string,long> words_, types_;
+    long n_files_ = 0, n_dirs_ = 0, all_files_size_ = 0;
+    std::set<std::pair<long,const WatchEntry *>> by_size_;
+    // inodes that may be duplicates: by size and partial hash, and once
+    // hashed by their SHA-256
+    std::map<std::pair<long,uint64_t>,std::vector<WatchInode *>> buckets_;
+    std::set<std::pair<long,uint64_t>> to_hash_; // buckets changed since the last hashing
+    std::unordered_map<std::string,std::vector<WatchInode *>> by_hash_;
+    std::set<WatchEntry *> links_; // the symlinks followed
+    long version_ = 0; // changes with every refresh
+    long last_version_ = -1; // of the Results last reported, for n = last_n_
+    int last_n_ = 0;
+    Results last_;
+
+    WorkQueues queues_ { 1 }; // for the Walk, visit_file() does not queue anything
+    Scratch sc_;
+
+    std::string path_of(const WatchDir * d) const {
+        if (! d->entry) return root_path_;
+        return path_of(d->entry->in) + "/" + *d->entry->name;
+    }
+    template <class T>
+    static void erase_from(std::vector<T *> & v, T * x) {
+        v.erase(std::find(v.begin(), v.end(), x));
+    }
+
+    void watch(WatchDir * d, const std::string & path) {
+        d->wd = inotify_add_watch(inotify_, path.c_str(), WATCH_EVENTS);
+        if (d->wd >= 0) watched_[d->wd].push_back(d);
+    }
+    void unwatch(WatchDir * d) {
+        if (d->wd < 0) return;
+        auto it = watched_.find(d->wd);
+        if (it == watched_.end()) return; //IN_IGNORED took it already
+        erase_from(it->second, d);
+        if (it->second.empty()) {
+            inotify_rm_watch(inotify_, d->wd);
+            watched_.erase(it);
+        }
+    }
+
+    // reads the entries of a directory into the model
+    void scan_dir(WatchDir * d) {
+        std::string path = path_of(d);
+        DIR * dir = opendir(path.c_str());
+        if (! dir) return;
+        std::vector<std::string> names;
+        while (struct dirent * de = readdir(dir)) {
+            const char * name = de->d_name;
+            if (name[0] == '.' && (name[1] == 0 || (name[1] == '.' && name[2] == 0))) continue;
+            names.push_back(name);
+        }
+        closedir(dir);
+        for (auto & name : names) add_entry(d, name);
+    }
+
+    // adds an entry (and everything below it) as it is now, if it exists
+    void add_entry(WatchDir * d, const std::string & name) {
+        std::string path = path_of(d) + "/" + name;
+        struct stat lst, st {};
+        if (lstat(path.c_str(), &lst) != 0) return; //gone already
+        bool is_link = S_ISLNK(lst.st_mode);
+        bool stat_ok = true;
+        if (! is_link || ! follow_links_) st = lst;
+        else stat_ok = stat(path.c_str(), &st) == 0;
+        //a symlink back up to a directory it is in is reported as the link
+        bool loop = false;
+        if (stat_ok && S_ISDIR(st.st_mode) && is_link)
+            for (WatchDir * a = d; a && ! loop; a = a->entry ? a->entry->in : nullptr)
+                loop = a->dev == st.st_dev && a->ino == st.st_ino;
+
+        auto it = d->entries.emplace(name, WatchEntry()).first;
+        WatchEntry & e = it->second;
+        e.in = d;
+        e.name = &it->first;
+        if (is_link && follow_links_) {
+            e.is_link = true;
+            if (stat_ok) {
+                e.to_dev = st.st_dev;
+                e.to_ino = st.st_ino;
+            }
+            links_.insert(&e);
+        }
+        if (loop) st = lst;
+        if (stat_ok && S_ISDIR(st.st_mode)) {
+            n_dirs_++;
+            e.dir.reset(new WatchDir { &e, st.st_dev, st.st_ino, -1, {} });
+            watch(e.dir.get(), path);
+            scan_dir(e.dir.get());
+            return;
+        }
+
+        int fd = -1;
+        if (stat_ok && S_ISREG(st.st_mode)) {
+            fd = open(path.c_str(), O_RDONLY | O_NONBLOCK | O_CLOEXEC | O_NOCTTY);
+            if (fd >= 0 && fstat(fd, &st) != 0) {
+                close(fd);
+                fd = -1;
+            }
+        }
+        WatchInode * node = nullptr;
+        std::vector<std::pair<WatchDir *,std::string>> stale;
+        if (fd >= 0 && S_ISREG(st.st_mode)) {
+            auto found = inodes_.find({ st.st_dev, st.st_ino });
+            if (found != inodes_.end() && found->second.key == cache_key(st)) node = &found->second;
+            else if (found != inodes_.end()) {
+                //new contents: the other paths to the inode are added again
+                //once it has been read
+                for (auto o : found->second.entries) stale.emplace_back(o->in, *o->name);
+                for (auto & o : stale) remove_entry(o.first, o.first->entries.find(o.second));
+            }
+        }
+
+        n_files_++;
+        if (node) { //its contents are known already
+            close(fd);
+            e.size = st.st_size;
+            e.type = is_link ? symlink_type(AT_FDCWD, path.c_str(), false) : node->type;
+            e.inode = node;
+            node->entries.push_back(&e);
+            add_words(node, 1);
+            to_hash_.emplace(node->key.size, node->partial);
+        }
+        else {
+            Task t;
+            t.full = path;
+            t.d_type = is_link ? DT_LNK : DT_REG;
+            Stats one;
+            Walk walk { queues_, nullptr, follow_links_, nullptr };
+            visit_file(t, fd, st, stat_ok, one, sc_, walk);
+            e.size = one.all_files_size;
+            e.type = one.types_hist.begin()->first;
+            if (! one.files.empty()) { //it could be read
+                WatchInode & in = inodes_[{ st.st_dev, st.st_ino }];
+                in.key = cache_key(st);
+                //a symlink got the type of the link, the inode needs its own
+                const FileScan & f = sc_.file;
+                in.type = is_link ? get_file_type(st, fd, f.head.data(), f.head.size()) : e.type;
+                in.partial = one.files[0].partial;
+                one.words_hist.for_each([&](std::string_view w, int count) { in.words.emplace_back(w, count); });
+                add_words(&in, 1);
+                in.entries.push_back(&e);
+                e.inode = &in;
+                std::pair<long,uint64_t> bucket(e.size, in.partial);
+                buckets_[bucket].push_back(&in);
+                to_hash_.insert(bucket);
+            }
+            if (fd >= 0) close(fd);
+        }
+        all_files_size_ += e.size;
+        types_[e.type]++;
+        by_size_.emplace(e.size, &e);
+        for (auto & o : stale) add_entry(o.first, o.second);
+    }
+
+    // takes an entry (and everything below it) out of the model
+    void remove_entry(WatchDir * d, std::map<std::string,WatchEntry>::iterator it) {
+        WatchEntry & e = it->second;
+        if (e.is_link) links_.erase(&e);
+        if (e.dir) {
+            WatchDir * sub = e.dir.get();
+            while (! sub->entries.empty()) remove_entry(sub, sub->entries.begin());
+            unwatch(sub);
+            n_dirs_--;
+            d->entries.erase(it);
+            return;
+        }
+        n_files_--;
+        all_files_size_ -= e.size;
+        if (--types_[e.type] == 0) types_.erase(e.type);
+        by_size_.erase({ e.size, &e });
+        if (WatchInode * node = e.inode) {
+            add_words(node, -1);
+            erase_from(node->entries, &e);
+            if (node->entries.empty()) drop_inode(node);
+        }
+        d->entries.erase(it);
+    }
+
+    // the words of an inode count once for each of its paths
+    void add_words(const WatchInode * node, int sign) {
+        for (auto & w : node->words) {
+            auto it = words_.emplace(w.first, 0).first;
+            if ((it->second += sign * w.second) == 0) words_.erase(it);
+        }
+    }
+
+    // the last path to an inode is gone
+    void drop_inode(WatchInode * node) {
+        std::pair<long,uint64_t> bucket(node->key.size, node->partial);
+        auto b = buckets_.find(bucket);
+        erase_from(b->second, node);
+        if (b->second.empty()) buckets_.erase(b);
+        if (! node->hash.empty()) {
+            auto h = by_hash_.find(node->hash);
+            erase_from(h->second, node);
+            if (h->second.empty()) by_hash_.erase(h);
+        }
+        inodes_.erase({ node->key.dev, node->key.ino });
+    }
+
+    // hashes the inodes in changed buckets that now hold 2 or more paths
+    void hash_candidates() {
+        std::vector<unsigned char> buf(READ_SIZE);
+        for (auto & bucket : to_hash_) {
+            auto b = buckets_.find(bucket);
+            if (b == buckets_.end()) continue;
+            size_t paths = 0;
+            for (auto node : b->second) paths += node->entries.size();
+            if (paths < 2) continue;
+            for (auto node : b->second) {
+                if (! node->hash.empty()) continue;
+                const WatchEntry * e = node->entries.front();
+                node->hash = sha256_of_file(path_of(e->in) + "/" + *e->name, buf);
+                if (! node->hash.empty()) by_hash_[node->hash].push_back(node);
+            }
+        }
+        to_hash_.clear();
+    }
+
+    // the symlinks that lead somewhere else now; only the directory of
+    // their target hears of it
+    std::set<std::string> moved_links() {
+        std::set<std::string> paths;
+        for (auto e : links_) {
+            std::string path = path_of(e->in) + "/" + *e->name;
+            struct stat st;
+            if (stat(path.c_str(), &st) == 0 ? st.st_dev != e->to_dev || st.st_ino != e->to_ino : e->to_ino != 0)
+                paths.insert(path);
+        }
+        return paths;
+    }
+
+    // rescans the paths events were reported for
+    void refresh(std::set<std::string> paths, bool everything) {
+        if (everything) {
+            while (! root_->entries.empty()) remove_entry(root_.get(), root_->entries.begin());
+            if (is_dir(root_path_)) scan_dir(root_.get());
+            paths.clear();
+        }
+        //a few more rounds for symlinks to what changed, and to those
+        for (int round = 0; round < 8 && ! paths.empty(); round++, paths = moved_links()) {
+            //what is there now goes first, so that the inodes of something
+            //renamed are still known when it is added under its new name
+            std::vector<std::string> order, gone;
+            for (auto & path : paths) {
+                struct stat st;
+                (lstat(path.c_str(), &st) == 0 ? order : gone).push_back(path);
+            }
+            order.insert(order.end(), gone.begin(), gone.end());
+            const std::string * done = nullptr;
+            for (auto & path : order) {
+                //a directory rescanned has everything below it rescanned too
+                if (done && path.compare(0, done->size() + 1, *done + "/") == 0) continue;
+                WatchDir * d = root_.get();
+                size_t pos = root_path_.size() + 1, slash;
+                while (d && (slash = path.find('/', pos)) != std::string::npos) {
+                    auto it = d->entries.find(path.substr(pos, slash - pos));
+                    d = it != d->entries.end() ? it->second.dir.get() : nullptr;
+                    pos = slash + 1;
+                }
+                if (! d) continue; //what it was in is gone
+                std::string name = path.substr(pos);
+                auto it = d->entries.find(name);
+                if (it != d->entries.end()) remove_entry(d, it);
+                add_entry(d, name);
+                done = &path;
+            }
+        }
+        hash_candidates();
+        version_++;
+    }
+
+    void run() {
+        std::vector<char> buf(64 * 1024);
+        std::set<std::string> dirty;
+        bool everything = false;
+        long first_ns = 0;
+        while (1) {
+            pollfd fds[2] = { { inotify_, POLLIN, 0 }, { stop_, POLLIN, 0 } };
+            bool waiting = everything || ! dirty.empty();
+            int timeout = waiting ? WATCH_SETTLE_MS : -1;
+            int r = poll(fds, 2, timeout);
+            if (r < 0 && errno == EINTR) continue;
+            if (r < 0 || fds[1].revents) break;
+            if (r == 0 || (waiting && now_ns() - first_ns > WATCH_MAX_DELAY_NS)) {
+                std::lock_guard<std::mutex> lk(m_);
+                refresh(dirty, everything);
+                dirty.clear();
+                everything = false;
+                if (r == 0) continue;
+            }
+            ssize_t len = read(inotify_, buf.data(), buf.size());
+            if (len <= 0) continue;
+            if (! everything && dirty.empty()) first_ns = now_ns();
+            std::lock_guard<std::mutex> lk(m_);
+            for (ssize_t off = 0; off < len; ) {
+                auto ev = (const inotify_event *) (buf.data() + off);
+                off += sizeof(inotify_event) + ev->len;
+                if (ev->mask & IN_Q_OVERFLOW) everything = true; //events were lost
+                auto it = watched_.find(ev->wd);
+                if (it == watched_.end()) continue;
+                if (ev->mask & IN_IGNORED) { //the directory is gone
+                    for (auto d : it->second) d->wd = -1;
+                    watched_.erase(it);
+                    continue;
+                }
+                if (ev->len == 0) { //the directory itself went away
+                    //its parent reports that too, but not to a symlink to it
+                    if (ev->mask & (IN_DELETE_SELF | IN_MOVE_SELF))
+                        for (auto d : it->second) {
+                            if (d == root_.get()) everything = true;
+                            else dirty.insert(path_of(d));
+                        }
+                    continue;
+                }
+                for (auto d : it->second) dirty.insert(path_of(d) + "/" + ev->name);
+            }
+        }
+    }
+
+    public:
+    // scans the tree, false if it is not a directory or cannot be watched
+    bool start(const std::string & root_dir) {
+        struct stat st;
+        if (stat(root_dir.c_str(), &st) != 0 || ! S_ISDIR(st.st_mode)) return false;
+        inotify_ = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+        stop_ = eventfd(0, EFD_CLOEXEC);
+        if (inotify_ < 0 || stop_ < 0) return false;
+        root_path_ = root_dir;
+        root_.reset(new WatchDir { nullptr, st.st_dev, st.st_ino, -1, {} });
+        sc_.file.head.reserve(SNIFF_SIZE);
+        {
+            std::lock_guard<std::mutex> lk(m_);
+            watch(root_.get(), root_path_);
+            scan_dir(root_.get());
+            hash_candidates();
+        }
+        thread_ = std::thread(&DirWatch::run, this);
+        return true;
+    }
+    ~DirWatch() {
+        if (thread_.joinable()) {
+            uint64_t one = 1;
+            if (write(stop_, &one, sizeof(one)) != sizeof(one)) perror("eventfd");
+            thread_.join();
+        }
+        if (inotify_ >= 0) close(inotify_);
+        if (stop_ >= 0) close(stop_);
+    }
+
+    Results results(int n) {
+        std::lock_guard<std::mutex> lk(m_);
+        if (last_version_ == version_ && last_n_ == n) return last_;
+        Results res;
+        res.n_files = n_files_;
+        res.n_dirs = n_dirs_;
+        res.all_files_size = all_files_size_;
+        res.largest_file_path = "";
+        res.largest_file_size = -1;
+        //the largest files are last, of those the first by name wins
+        for (auto it = by_size_.rbegin(); it != by_size_.rend() && it->first == by_size_.rbegin()->first; it++) {
+            std::string path = path_of(it->second->in) + "/" + *it->second->name;
+            if (res.largest_file_size < 0 || path < res.largest_file_path) res.largest_file_path = path;
+            res.largest_file_size = it->first;
+        }
+
+        //most common words and types, by count and then by name
+        auto top = [n](const std::unordered_map<std::string,long> & hist) {
+            std::vector<std::pair<long,const std::string *>> arr;
+            for (auto & h : hist) arr.emplace_back(-h.second, &h.first);
+            auto cmp = [](const std::pair<long,const std::string *> & a, const std::pair<long,const std::string *> & b) {
+                return a.first != b.first ? a.first < b.first : *a.second < *b.second;
+            };
+            size_t k = std::min(arr.size(), size_t(std::max(n, 0)));
+            std::partial_sort(arr.begin(), arr.begin() + k, arr.end(), cmp);
+            std::vector<std::pair<std::string,int>> res;
+            for (size_t i = 0; i < k; i++) res.emplace_back(*arr[i].second, -arr[i].first);
+            return res;
+        };
+        res.most_common_words = top(words_);
+        res.most_common_types = top(types_);
+
+        //duplicates, largest groups first like getDirStats()
+        std::set<std::pair<int,std::vector<std::string>>> mmq;
+        for (auto & h : by_hash_) {
+            std::vector<std::string> paths;
+            for (auto node : h.second)
+                for (auto e : node->entries) paths.push_back(path_of(e->in) + "/" + *e->name);
+            if (paths.size() < 2) continue;
+            std::sort(paths.begin(), paths.end());
+            mmq.emplace(-int(paths.size()), std::move(paths));
+            if (mmq.size() > size_t(n)) mmq.erase(std::prev(mmq.end()));
+        }
+        for (auto & v : mmq) res.duplicate_files.push_back(v.second);
+        last_ = res;
+        last_version_ = version_;
+        last_n_ = n;
+        return res;
+    }
+};
+
+// the running watches by id; never destroyed, as exit() may be called with
+// their threads still running (even by one of them)
+static std::mutex watches_m;
+static std::map<int,std::unique_ptr<DirWatch>> & watches = * new std::map<int,std::unique_ptr<DirWatch>>;
+static int next_watch_id = 1;
+
+// getDirStats() computes stats about directory a directory
+//         root_dir = name of the directory to examine
+//         n = how many top words/filet types/groups to report
+// with DIRSTATS_TOP_COUNTERS=k in the environment it counts words and types
+// like getDirStats_approx() does with max_counters = k
+Results getDirStats(const std::string & root_dir, int n)
+{
+    const char * s = getenv("DIRSTATS_TOP_COUNTERS");
+    long k = s ? atol(s) : 0;
+    return dir_stats(root_dir, n, std::max(k, 0L), nullptr, nullptr);
+}
+
+// like getDirStats(), but the most common words and types are counted in
+// bounded memory: at most max_counters distinct words (and as many types)
+// are kept per worker, which takes around 250 bytes per counter plus the
+// longest words, and as many again (plus one block read) for the words of
+// the file being read; the counts reported are upper bounds and
+//         word_errors[i] = how much most_common_words[i] may be too high
+Results getDirStats_approx(const std::string & root_dir, int n, size_t max_counters, std::vector<long> & word_errors)
+{
+    word_errors.clear();
+    return dir_stats(root_dir, n, std::max<size_t>(max_counters, 1), &word_errors, nullptr);
+}
+
+// like getDirStats(), and also tells where the time went
+//         metrics = the wall time, files and directories per second, bytes
+//                   read, nanoseconds per phase (summed over the workers)
+//                   and syscall counts
+Results getDirStats_metrics(const std::string & root_dir, int n, Metrics & metrics)
+{
+    const char * s = getenv("DIRSTATS_TOP_COUNTERS");
+    long k = s ? atol(s) : 0;
+    return dir_stats(root_dir, n, std::max(k, 0L), nullptr, &metrics);
+}
+
+// getDirStats_watch_start() scans a directory like getDirStats() does, then
+// keeps its stats up to date from inotify events on a thread of its own,
+// until getDirStats_watch_stop()
+//         root_dir = name of the directory to watch
+// returns the id of the watch, or -1 if root_dir is not a directory or
+// inotify is not available
+int getDirStats_watch_start(const std::string & root_dir)
+{
+    std::unique_ptr<DirWatch> w(new DirWatch());
+    if (! w->start(root_dir)) return -1;
+    std::lock_guard<std::mutex> lk(watches_m);
+    int id = next_watch_id++;
+    watches[id] = std::move(w);
+    return id;
+}
+
+// the stats of a watched directory as they are now, like getDirStats() would
+// report them, or empty Results if there is no watch with that id
+Results getDirStats_watch_results(int id, int n)
+{
+    std::lock_guard<std::mutex> lk(watches_m);
+    auto it = watches.find(id);
+    if (it != watches.end()) return it->second->results(n);
+    Results res;
+    res.all_files_size = 0;
+    res.n_files = 0;
+    res.n_dirs = 0;
+    res.largest_file_path = "";
+    res.largest_file_size = -1;
+    return res;
+}
+
+// stops a watch and frees everything it kept
+void getDirStats_watch_stop(int id)
+{
+    std::unique_ptr<DirWatch> w;
+    {
+        std::lock_guard<std::mutex> lk(watches_m);
+        auto it = watches.find(id);
+        if (it == watches.end()) return;
+        w = std::move(it->second);
+        watches.erase(it);
+    }
+}
@@ -0,0 +1,50 @@
+#pragma once
+#include <string>
+#include <vector>
+struct Results {
+  std::string largest_file_path;
+  long largest_file_size;
+  long n_files;
+  long n_dirs;
+  long all_files_size;
+  std::vector<std::pair<std::string, int>> most_common_types;
+  std::vector<std::pair<std::string, int>> most_common_words;
+  std::vector<std::vector<std::string>> duplicate_files;
+  bool valid;
+};
+Results getDirStats(const std::string & dir_name, int n);
+
+// the same with bounded memory for the word and type counts, word_errors[i]
+// is how much most_common_words[i] may be too high
+Results getDirStats_approx(const std::string & dir_name, int n, size_t max_counters, std::vector<long> & word_errors);
+
+// where the time of a scan went, the phases are summed over the workers and
+// the syscalls include those done through io_uring
+struct Metrics {
+  long wall_ns;
+  int workers;
+  long files;
+  long dirs;
+  double files_per_sec;
+  double dirs_per_sec;
+  long bytes_read;
+  long cache_hits;
+  long hashed_files;
+  long traverse_ns, open_stat_ns, read_ns, tokenize_ns, file_type_ns;
+  long io_wait_ns, full_hash_ns, cache_write_ns, report_ns;
+  long open_calls, stat_calls, read_calls, getdents_calls, close_calls, io_uring_enter_calls;
+};
+
+// the same, and metrics is set to where the time went
+Results getDirStats_metrics(const std::string & dir_name, int n, Metrics & metrics);
+
+// keeps the stats of a directory up to date from inotify events, start
+// returns the id to pass to the others, or -1 on failure
+int getDirStats_watch_start(const std::string & dir_name);
+Results getDirStats_watch_results(int id, int n);
+void getDirStats_watch_stop(int id);
+
+// what getDirStats() reports as the type of a file, from its stat, its fd
+// (-1 if it could not be opened) and the first n bytes of it
+struct stat;
+std::string get_file_type(const struct stat & st, int fd, const unsigned char * b, size_t n);
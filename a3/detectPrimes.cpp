@@ -10,7 +10,6 @@
 /// defined in "detectPrimes.h".
 
 #include "detectPrimes.h"
-#include <cmath>
 #include <cstdio>
 #include <cstdlib>
 #include <mutex>
@@ -25,6 +24,8 @@ std::vector<int64_t> result; //initialize empty result vector
 bool * thread_results; //individual thread results
 
 int64_t n; //global var that tracks the current number
+bool n_pending; //n is waiting for the threads' verdict
+size_t next_num; //index in nums of the next number to look at
 
 // C++ barrier class (from lecture notes).
 // -----------------------------------------------------------------------------
@@ -60,40 +61,97 @@ class simple_barrier {
 };
 
 
+// Montgomery arithmetic modulo an odd n < 2^63, numbers are kept as
+// x * 2^64 mod n so a multiplication needs no division
+// -----------------------------------------------------------------------------
+struct Montgomery {
+    uint64_t n;
+    uint64_t inv; //n^-1 mod 2^64
+
+    Montgomery(uint64_t n) : n(n), inv(n)
+    {
+        //Newton's iteration, each step doubles the correct low bits (n*n = 1 mod 8)
+        for (int i = 0; i < 5; i++) inv *= 2 - n * inv;
+    }
+    uint64_t to(uint64_t x) const { return ((unsigned __int128) x << 64) % n; }
+    // a * b / 2^64 mod n: t - m * n with m chosen so the low halves cancel
+    uint64_t mul(uint64_t a, uint64_t b) const
+    {
+        unsigned __int128 t = (unsigned __int128) a * b;
+        uint64_t m = uint64_t(t) * inv;
+        uint64_t hi = t >> 64, mn = ((unsigned __int128) m * n) >> 64;
+        return hi >= mn ? hi - mn : hi - mn + n;
+    }
+    uint64_t pow(uint64_t a, uint64_t e) const
+    {
+        uint64_t r = to(1);
+        for (; e; e >>= 1) {
+            if (e & 1) r = mul(r, a);
+            a = mul(a, a);
+        }
+        return r;
+    }
+};
+
+// these 7 bases decide every n < 2^64 (Jim Sinclair's set)
+static const uint64_t mr_bases[] = {2, 325, 9375, 28178, 450775, 9780504, 1795265022};
+static const int n_mr_bases = sizeof(mr_bases) / sizeof(mr_bases[0]);
+
+// trial division by the small primes, rejects most composites quickly
+// returns 1 if n is prime, 0 if not, -1 if it takes is_prime() to tell
+// -----------------------------------------------------------------------------
+static int small_prime_test(int64_t n)
+{
+    if (n < 2) return 0;
+    static const int small_primes[] = {2, 3, 5, 7, 11, 13, 17, 19, 23, 29, 31, 37, 41, 43, 47, 53, 59, 61, 67, 71, 73, 79, 83, 89, 97};
+    for (int p : small_primes) {
+        if (n == p) return 1;
+        if (n % p == 0) return 0;
+    }
+    if (n < 101 * 101) return 1; //no divisor up to its square root
+    return -1;
+}
+
 // returns true if n is prime, otherwise returns false
+// n has no factor below 101 (small_prime_test() returned -1)
 // -----------------------------------------------------------------------------
 static bool is_prime(int64_t n, int tid, int n_threads)
 {
     // handle trivial cases
     if(global_cancel) return true;
-    if (n < 2) return false;
-    if (n <= 3) return true; // 2 and 3 are primes
-    if (n % 2 == 0) return false; // handle multiples of 2
-    if (n % 3 == 0) return false; // handle multiples of 3
-
-    // try to divide n by every number 5 .. sqrt(n)
-    //using skip method, so starting point and increments modified
-    int64_t i = 5 + (6 * tid); 
-    int64_t max = sqrt(n);
-    while (i <= max && !global_cancel) {
-        if (n % i == 0) return false;
-        if (n % (i + 2) == 0) return false;
-        i += (6 * n_threads);
+
+    //deterministic Miller-Rabin, the bases are split between the threads
+    //n - 1 = d * 2^s with d odd
+    Montgomery mont(n);
+    uint64_t d = n - 1;
+    int s = __builtin_ctzll(d);
+    d >>= s;
+    uint64_t one = mont.to(1), minus_one = n - one;
+    for (int k = tid; k < n_mr_bases && !global_cancel; k += n_threads) {
+        uint64_t a = mr_bases[k] % n;
+        if (a == 0) continue; //a multiple of n proves nothing
+        uint64_t x = mont.pow(mont.to(a), d);
+        if (x == one || x == minus_one) continue;
+        int i = 1;
+        for (; i < s; i++) {
+            x = mont.mul(x, x);
+            if (x == minus_one) break;
+        }
+        if (i == s) return false; //a is a witness, n is composite
     }
-    // didn't find any divisors, so it must be a prime
+    // no base is a witness, so it must be a prime
     return true;
 }
 
 void task(int tid, simple_barrier & barrier, const std::vector<int64_t> & nums, int n_threads)
 {   
-    unsigned int i = 0; //current index in relation to nums
     bool totalresult; //the final combined result of all threads
 
     while(1) {
         //serial task picks one w/ barrier
         if(barrier.wait()) {
             global_cancel = false; //resets cancel flag
-            if(i > 0) { //if we're not on the first loop, run the end code
+            if(n_pending) { //if the threads just tested a number, run the end code
                 //combine per-thread results
                 totalresult = true;
                 for(int j = 0; j < n_threads; j++) {
@@ -105,10 +163,20 @@ void task(int tid, simple_barrier & barrier, const std::vector<int64_t> & nums,
                 if(totalresult) result.push_back(n);
             }
 
-            //get next number from nums
-            n = nums[i]; 
+            //get next number from nums, settling the ones the small
+            //primes decide right here, without another round of the barrier
+            n_pending = false;
+            while(next_num < nums.size() && !n_pending) {
+                int64_t x = nums[next_num++];
+                int small = small_prime_test(x);
+                if(small == 1) result.push_back(x);
+                else if(small == -1) {
+                    n = x;
+                    n_pending = true;
+                }
+            }
             //if no numbers left, sets flag
-            if(i >= nums.size()) global_finished = true;
+            if(!n_pending) global_finished = true;
         }
         barrier.wait();
         //end serial task
@@ -121,7 +189,6 @@ void task(int tid, simple_barrier & barrier, const std::vector<int64_t> & nums,
             if(!thread_results[tid])
                 global_cancel = true; //cancels all other current operations
         }
-        i++; //increments nums index
         //end parallel task
     }
 }
@@ -140,6 +207,8 @@ detect_primes(const std::vector<int64_t> & nums, int n_threads)
     
     bool a[n_threads];
     thread_results = a;
+    n_pending = false;
+    next_num = 0;
 
 
     for(int i = 0; i < n_threads; i++) {